@@ -0,0 +1,234 @@
+#ifndef BARRETT_H
+#define BARRETT_H
+
+#include <stdexcept>
+#include "bigint.h"
+#include "scratch_arena.h"
+#include "memtrace.h"
+
+/**
+ * Precomputed reciprocal for Barrett reduction modulo a fixed modulus.
+ * Unlike Montgomery multiplication the numbers stay in the normal representation,
+ * so it pays off already for a handful of reductions, e.g. the exponentiations of a single prime_check.
+ * Products are kept at double width, so the modulus may use all bits of the storage.
+ * @tparam bits number of bits used to store the integers.
+ */
+template <unsigned int bits>
+struct BarrettContext
+{
+    Bigint<bits> modulus;
+    // number of array elements needed to store the modulus (k)
+    unsigned int limbs;
+    // floor(2^(64 * limbs) / modulus), it takes limbs + 1 array elements, limbs + 2 if the modulus is a power of 2^32
+    unsigned int mu[bits / (sizeof(unsigned int) * 8) + 2];
+    unsigned int mu_limbs;
+    BarrettContext(const Bigint<bits> &);
+    // x % modulus, with a bit-serial division if x doesn't fit into 2 * limbs array elements
+    Bigint<bits> reduce(const Bigint<bits> &) const;
+    // a * b % modulus, the product isn't truncated to bits
+    Bigint<bits> multiply(const Bigint<bits> &, const Bigint<bits> &) const;
+    // modular exponentiation with the precomputed modulus
+    Bigint<bits> exponentiation(const Bigint<bits> &, const Bigint<bits> &) const;
+
+private:
+    static constexpr unsigned int n = bits / (sizeof(unsigned int) * 8);
+    // reduces a number stored in 2 * limbs array elements
+    Bigint<bits> reduce_wide(const unsigned int *) const;
+    unsigned int modulus_limb(const unsigned int &i) const { return i < limbs ? modulus.storage[i] : 0; }
+};
+
+/**
+ * Calculates mu with a bit-serial long division of 2^(64 * limbs), it's done only once per modulus.
+ * @param m the modulus, it can't be 0.
+ */
+template <unsigned int bits>
+BarrettContext<bits>::BarrettContext(const Bigint<bits> &m) : modulus(m), mu{0}
+{
+    if (m == BigintConstant<bits>())
+        throw std::domain_error("Barrett modulus can't be 0");
+    limbs = (m.num_bits() + sizeof(unsigned int) * 8 - 1) / (sizeof(unsigned int) * 8);
+    mu_limbs = limbs + 1;
+    // the remainder is less than 2 * modulus after the doubling, one more element holds the extra bit
+    unsigned int rem[n + 1] = {0};
+    unsigned long long temp;
+    for (int i = 2 * limbs * sizeof(unsigned int) * 8; i >= 0; --i)
+    {
+        // rem = 2 * rem + (the i-th bit of 2^(64 * limbs))
+        unsigned int carry = i == (int)(2 * limbs * sizeof(unsigned int) * 8);
+        for (unsigned int j = 0; j <= limbs; ++j)
+        {
+            unsigned int next = rem[j] >> (sizeof(unsigned int) * 8 - 1);
+            rem[j] = (rem[j] << 1) | carry;
+            carry = next;
+        }
+        // rem >= modulus
+        bool greater = true;
+        for (int j = limbs; j >= 0; --j)
+            if (rem[j] != modulus_limb(j))
+            {
+                greater = rem[j] > modulus_limb(j);
+                break;
+            }
+        if (!greater)
+            continue;
+        unsigned int borrow = 0;
+        for (unsigned int j = 0; j <= limbs; ++j)
+        {
+            temp = (unsigned long long)rem[j] - ((unsigned long long)modulus_limb(j) + borrow);
+            borrow = temp >> (8 * sizeof(unsigned long long) - 1);
+            rem[j] = (unsigned int)temp;
+        }
+        mu[i / (sizeof(unsigned int) * 8)] |= 1U << (i % (sizeof(unsigned int) * 8));
+        if (i / (sizeof(unsigned int) * 8) >= mu_limbs)
+            mu_limbs = i / (sizeof(unsigned int) * 8) + 1;
+    }
+}
+
+/**
+ * Barrett reduction (Handbook of Applied Cryptography, algorithm 14.42) with b = 2^32 and k = limbs.
+ * The quotient estimate is computed from the full product of floor(x / b^(k-1)) and mu,
+ * only the product of the estimate and the modulus is truncated (it's only needed modulo b^(k+1)).
+ * The estimate is at most 2 less than the real quotient, so at most 2 subtractions are needed at the end.
+ * @param x 2 * limbs array elements
+ * @return x % modulus
+ */
+template <unsigned int bits>
+Bigint<bits> BarrettContext<bits>::reduce_wide(const unsigned int *x) const
+{
+    BIGINT_COUNT(op_barrett_reduce, bits);
+    unsigned long long carry;
+    unsigned long long temp;
+    // q2 = floor(x / b^(k-1)) * mu, the upper elements from k + 1 are the quotient estimate
+    const unsigned int *q1 = x + limbs - 1;
+    ScratchArray<2 * n + 3> q2_limbs(limbs + mu_limbs + 1);
+    unsigned int *q2 = q2_limbs.limbs();
+    std::memset(q2, 0, (limbs + mu_limbs + 1) * sizeof(unsigned int));
+    for (unsigned int i = 0; i <= limbs; ++i)
+    {
+        carry = 0;
+        for (unsigned int j = 0; j < mu_limbs; ++j)
+        {
+            temp = (unsigned long long)q2[i + j] + (unsigned long long)q1[i] * (unsigned long long)mu[j] + carry;
+            q2[i + j] = (unsigned int)temp;
+            carry = temp >> (8 * sizeof(unsigned int));
+        }
+        q2[i + mu_limbs] = (unsigned int)carry;
+    }
+    const unsigned int *q3 = q2 + limbs + 1;
+    // r = x - q3 * modulus, both sides are taken modulo b^(k+1)
+    ScratchArray<n + 2> r_limbs(limbs + 1);
+    unsigned int *r = r_limbs.limbs();
+    std::memset(r, 0, (limbs + 1) * sizeof(unsigned int));
+    for (unsigned int i = 0; i <= limbs; ++i)
+    {
+        carry = 0;
+        for (unsigned int j = 0; j < limbs && i + j <= limbs; ++j)
+        {
+            temp = (unsigned long long)r[i + j] + (unsigned long long)q3[i] * (unsigned long long)modulus.storage[j] + carry;
+            r[i + j] = (unsigned int)temp;
+            carry = temp >> (8 * sizeof(unsigned int));
+        }
+        if (i == 0)
+            r[limbs] = (unsigned int)carry;
+    }
+    unsigned int borrow = 0;
+    for (unsigned int i = 0; i <= limbs; ++i)
+    {
+        temp = (unsigned long long)x[i] - ((unsigned long long)r[i] + borrow);
+        borrow = temp >> (8 * sizeof(unsigned long long) - 1);
+        r[i] = (unsigned int)temp;
+    }
+    // r < 3 * modulus, the corrections are plain subtractions
+    for (unsigned int c = 0; c < 2; ++c)
+    {
+        bool greater = true;
+        for (int j = limbs; j >= 0; --j)
+            if (r[j] != modulus_limb(j))
+            {
+                greater = r[j] > modulus_limb(j);
+                break;
+            }
+        if (!greater)
+            break;
+        BIGINT_COUNT(op_barrett_correction, bits);
+        borrow = 0;
+        for (unsigned int j = 0; j <= limbs; ++j)
+        {
+            temp = (unsigned long long)r[j] - ((unsigned long long)modulus_limb(j) + borrow);
+            borrow = temp >> (8 * sizeof(unsigned long long) - 1);
+            r[j] = (unsigned int)temp;
+        }
+    }
+    Bigint<bits> res;
+    for (unsigned int i = 0; i < limbs; ++i)
+        res.storage[i] = r[i];
+    return res;
+}
+
+/**
+ * @param x any number, the ones using more than 2 * limbs array elements fall back to operator%
+ * @return x % modulus
+ */
+template <unsigned int bits>
+Bigint<bits> BarrettContext<bits>::reduce(const Bigint<bits> &x) const
+{
+    if (x.num_bits() > 2 * limbs * sizeof(unsigned int) * 8)
+        return x % modulus;
+    ScratchArray<2 * n> wide_limbs(2 * limbs);
+    unsigned int *wide = wide_limbs.limbs();
+    std::memset(wide, 0, 2 * limbs * sizeof(unsigned int));
+    for (unsigned int i = 0; i < 2 * limbs && i < n; ++i)
+        wide[i] = x.storage[i];
+    return reduce_wide(wide);
+}
+
+/**
+ * Schoolbook multiplication into a double width array followed by a Barrett reduction.
+ * @param a must be less than the modulus
+ * @param b must be less than the modulus
+ * @return a * b % modulus
+ */
+template <unsigned int bits>
+Bigint<bits> BarrettContext<bits>::multiply(const Bigint<bits> &a, const Bigint<bits> &b) const
+{
+    ScratchArray<2 * n> wide_limbs(2 * limbs);
+    unsigned int *wide = wide_limbs.limbs();
+    std::memset(wide, 0, 2 * limbs * sizeof(unsigned int));
+    unsigned long long carry;
+    unsigned long long temp;
+    for (unsigned int i = 0; i < limbs; ++i)
+    {
+        carry = 0;
+        for (unsigned int j = 0; j < limbs; ++j)
+        {
+            temp = (unsigned long long)wide[i + j] + (unsigned long long)a.storage[i] * (unsigned long long)b.storage[j] + carry;
+            wide[i + j] = (unsigned int)temp;
+            carry = temp >> (8 * sizeof(unsigned int));
+        }
+        wide[i + limbs] = (unsigned int)carry;
+    }
+    return reduce_wide(wide);
+}
+
+/**
+ * Left-to-right square and multiply exponentiation, there's no conversion before or after the loop.
+ * @param a the base, it's reduced first if it's not less than the modulus
+ * @param b the exponent
+ * @return aˆb % modulus
+ */
+template <unsigned int bits>
+Bigint<bits> BarrettContext<bits>::exponentiation(const Bigint<bits> &a, const Bigint<bits> &b) const
+{
+    Bigint<bits> base = a < modulus ? a : reduce(a);
+    // 1 % modulus, it's 0 if the modulus is 1
+    Bigint<bits> c = reduce(Bigint<bits>(1));
+    for (int i = b.num_bits() - 1; i >= 0; --i)
+    {
+        c = multiply(c, c);
+        if ((b.storage[i / (sizeof(unsigned int) * 8)] >> (i % (sizeof(unsigned int) * 8))) & 1)
+            c = multiply(c, base);
+    }
+    return c;
+}
+
+#endif
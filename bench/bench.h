@@ -0,0 +1,267 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+/**
+ * Small benchmark harness shared by the benchmark programs.
+ * Every benchmark is warmed up, then timed for a number of repetitions,
+ * the statistics are printed as a table and can be written as JSON.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+namespace bench
+{
+
+/**
+ * Command line settings common to every benchmark program.
+ */
+struct Settings
+{
+    // number of untimed calls before measuring
+    unsigned int warmup;
+    // maximum number of timed repetitions
+    unsigned int repetitions;
+    // minimum number of timed repetitions, even if the time budget runs out
+    unsigned int min_repetitions;
+    // time budget of a single benchmark in seconds
+    double budget;
+    // only the benchmarks whose name contains this are run
+    std::string filter;
+    // the results are written here as JSON if it's not empty
+    std::string json;
+    Settings() : warmup(3), repetitions(1000), min_repetitions(5), budget(0.5) {}
+};
+
+/**
+ * The statistics of a single benchmark, every time is for one call in nanoseconds.
+ */
+struct Result
+{
+    std::string name;
+    unsigned int width;
+    unsigned int repetitions;
+    double min;
+    double median;
+    double mean;
+    double p99;
+    // throughput, 0 if it's not measured
+    double calls_per_second;
+    double bytes_per_second;
+};
+
+// keeps the compiler from removing the calculation of x
+template <typename T>
+inline void do_not_optimize(const T &x)
+{
+    asm volatile("" : : "r"(&x) : "memory");
+}
+
+/**
+ * @return the p-th percentile (0 <= p <= 1) of sorted, using the nearest-rank method
+ */
+inline double percentile(const std::vector<double> &sorted, const double &p)
+{
+    size_t rank = (size_t)(p * sorted.size() + 0.999999);
+    if (rank == 0)
+        rank = 1;
+    return sorted[std::min(rank, sorted.size()) - 1];
+}
+
+/**
+ * Computes the statistics of the measured samples.
+ */
+inline Result summarize(const std::string &name, const unsigned int &width, std::vector<double> samples)
+{
+    Result res;
+    res.name = name;
+    res.width = width;
+    res.repetitions = samples.size();
+    std::sort(samples.begin(), samples.end());
+    res.min = samples.front();
+    res.median = samples.size() % 2 ? samples[samples.size() / 2] : (samples[samples.size() / 2 - 1] + samples[samples.size() / 2]) / 2;
+    double sum = 0;
+    for (size_t i = 0; i < samples.size(); ++i)
+        sum += samples[i];
+    res.mean = sum / samples.size();
+    res.p99 = percentile(samples, 0.99);
+    res.calls_per_second = 0;
+    res.bytes_per_second = 0;
+    return res;
+}
+
+/**
+ * Times f(). Fast calls are repeated in batches so that a sample is well above the clock resolution.
+ * @param name the name of the benchmark
+ * @param width the bit-width of the operands
+ * @param settings warmup, repetitions and time budget
+ * @param f the measured call
+ */
+template <typename F>
+Result run(const std::string &name, const unsigned int &width, const Settings &settings, F f)
+{
+    typedef std::chrono::steady_clock clock;
+    for (unsigned int i = 0; i < settings.warmup; ++i)
+        f();
+    // calibrate the batch size to about 2 microseconds
+    unsigned int batch = 1;
+    while (true)
+    {
+        clock::time_point start = clock::now();
+        for (unsigned int i = 0; i < batch; ++i)
+            f();
+        double elapsed = std::chrono::duration<double, std::nano>(clock::now() - start).count();
+        if (elapsed > 2000 || batch >= (1U << 20))
+            break;
+        batch *= 2;
+    }
+    std::vector<double> samples;
+    clock::time_point begin = clock::now();
+    while (samples.size() < settings.repetitions)
+    {
+        clock::time_point start = clock::now();
+        for (unsigned int i = 0; i < batch; ++i)
+            f();
+        clock::time_point stop = clock::now();
+        samples.push_back(std::chrono::duration<double, std::nano>(stop - start).count() / batch);
+        if (samples.size() >= settings.min_repetitions && std::chrono::duration<double>(stop - begin).count() > settings.budget)
+            break;
+    }
+    return summarize(name, width, samples);
+}
+
+inline void print_header()
+{
+    std::printf("%-24s %6s %6s %14s %14s %14s\n", "benchmark", "width", "reps", "median (ns)", "p99 (ns)", "min (ns)");
+}
+
+inline void print(const Result &r)
+{
+    std::printf("%-24s %6u %6u %14.1f %14.1f %14.1f\n", r.name.c_str(), r.width, r.repetitions, r.median, r.p99, r.min);
+    std::fflush(stdout);
+}
+
+/**
+ * Writes the results as JSON, one benchmark per line so the files are easy to diff and parse.
+ * @return false if the file couldn't be opened
+ */
+inline bool write_json(const std::string &path, const std::vector<Result> &results)
+{
+    FILE *fp = std::fopen(path.c_str(), "w");
+    if (fp == NULL)
+        return false;
+    std::fprintf(fp, "{\"benchmarks\": [\n");
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        const Result &r = results[i];
+        std::fprintf(fp, "{\"name\": \"%s\", \"width\": %u, \"repetitions\": %u, \"min_ns\": %.1f, \"median_ns\": %.1f, \"mean_ns\": %.1f, \"p99_ns\": %.1f",
+                     r.name.c_str(), r.width, r.repetitions, r.min, r.median, r.mean, r.p99);
+        if (r.calls_per_second != 0)
+            std::fprintf(fp, ", \"calls_per_s\": %.1f, \"bytes_per_s\": %.1f", r.calls_per_second, r.bytes_per_second);
+        std::fprintf(fp, "}%s\n", i + 1 < results.size() ? "," : "");
+    }
+    std::fprintf(fp, "]}\n");
+    std::fclose(fp);
+    return true;
+}
+
+/**
+ * Reads the name, width and median of every benchmark from a file written by write_json.
+ * @return false if the file couldn't be opened
+ */
+inline bool read_json(const std::string &path, std::vector<Result> &results)
+{
+    FILE *fp = std::fopen(path.c_str(), "r");
+    if (fp == NULL)
+        return false;
+    char line[1024];
+    while (std::fgets(line, sizeof(line), fp) != NULL)
+    {
+        const char *name = std::strstr(line, "\"name\": \"");
+        const char *width = std::strstr(line, "\"width\": ");
+        const char *median = std::strstr(line, "\"median_ns\": ");
+        if (name == NULL || width == NULL || median == NULL)
+            continue;
+        name += std::strlen("\"name\": \"");
+        const char *end = std::strchr(name, '"');
+        if (end == NULL)
+            continue;
+        Result r = Result();
+        r.name.assign(name, end);
+        r.width = std::atoi(width + std::strlen("\"width\": "));
+        r.median = std::atof(median + std::strlen("\"median_ns\": "));
+        results.push_back(r);
+    }
+    std::fclose(fp);
+    return true;
+}
+
+/**
+ * Compares the medians of two result files written by write_json and prints the differences.
+ * @param threshold a benchmark is a regression if its median grew more than this many percent
+ * @return the number of regressions, -1 if a file couldn't be read
+ */
+inline int compare(const std::string &old_path, const std::string &new_path, const double &threshold)
+{
+    std::vector<Result> before, after;
+    if (!read_json(old_path, before) || !read_json(new_path, after))
+        return -1;
+    int regressions = 0;
+    std::printf("%-24s %8s %14s %14s %9s\n", "benchmark", "width", "old (ns)", "new (ns)", "change");
+    for (size_t i = 0; i < after.size(); ++i)
+    {
+        for (size_t j = 0; j < before.size(); ++j)
+        {
+            if (before[j].name != after[i].name || before[j].width != after[i].width)
+                continue;
+            double change = before[j].median > 0 ? (after[i].median / before[j].median - 1) * 100 : 0;
+            bool regression = change > threshold;
+            regressions += regression;
+            std::printf("%-24s %8u %14.1f %14.1f %+8.1f%%%s\n", after[i].name.c_str(), after[i].width,
+                        before[j].median, after[i].median, change, regression ? "  REGRESSION" : "");
+            break;
+        }
+    }
+    return regressions;
+}
+
+/**
+ * Parses a common command line option, the options are:
+ * --json file, --filter name, --warmup n, --repetitions n, --budget seconds
+ * @param i the index of the option, it's moved to its last used argument
+ * @return false if argv[i] isn't a common option
+ */
+inline bool parse_setting(int argc, char **argv, int &i, Settings &settings)
+{
+    if (i + 1 >= argc)
+        return false;
+    if (!std::strcmp(argv[i], "--json"))
+        settings.json = argv[++i];
+    else if (!std::strcmp(argv[i], "--filter"))
+        settings.filter = argv[++i];
+    else if (!std::strcmp(argv[i], "--warmup"))
+        settings.warmup = std::atoi(argv[++i]);
+    else if (!std::strcmp(argv[i], "--repetitions"))
+        settings.repetitions = std::atoi(argv[++i]);
+    else if (!std::strcmp(argv[i], "--budget"))
+        settings.budget = std::atof(argv[++i]);
+    else
+        return false;
+    if (settings.min_repetitions > settings.repetitions)
+        settings.min_repetitions = settings.repetitions;
+    return true;
+}
+
+inline bool selected(const Settings &settings, const std::string &name)
+{
+    return settings.filter.empty() || name.find(settings.filter) != std::string::npos;
+}
+
+} // namespace bench
+
+#endif
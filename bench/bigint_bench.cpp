@@ -0,0 +1,125 @@
+/**
+ * Microbenchmarks of every Bigint operation at widths from 64 to 8192 bits.
+ * Usage: bigint_bench [--json file] [--filter name] [--warmup n] [--repetitions n] [--budget seconds]
+ *                     [--max-width bits] [--max-exp-width bits]
+ * The modular exponentiation based benchmarks (exponentiation, prime_check) are slow at large
+ * widths, they are limited by --max-exp-width (2048 by default).
+ */
+
+#include <iostream>
+#include "bench.h"
+#include "../bigint.h"
+#include "../montgomery.h"
+
+static unsigned int max_width = 8192;
+static unsigned int max_exp_width = 2048;
+
+/**
+ * @return a random number with exactly n bits, n has to be a multiple of 32
+ */
+template <unsigned int bits>
+Bigint<bits> random_bits(const unsigned int &n)
+{
+    Bigint<bits> x;
+    x.rng(n);
+    x.storage[n / 32 - 1] |= 0x80000000U;
+    return x;
+}
+
+template <unsigned int bits>
+void run_width(const bench::Settings &settings, std::vector<bench::Result> &results)
+{
+    if (bits > max_width)
+        return;
+    // half-width operands so that products don't overflow
+    Bigint<bits> a = random_bits<bits>(bits > 64 ? bits / 2 : 32);
+    Bigint<bits> b = random_bits<bits>(bits > 64 ? bits / 2 : 32);
+    // a full-width dividend and a half-width odd modulus
+    Bigint<bits> wide = random_bits<bits>(bits) >> 1;
+    Bigint<bits> m = b;
+    m.storage[0] |= 1;
+    Bigint<bits> small = a % m;
+    // inverse needs coprime operands, otherwise it divides by zero
+    while (small.gcd(m) != BigintConstant<bits>(1))
+        small = small + Bigint<bits>(1);
+    Bigint<bits> res;
+    bool flag = false;
+
+#define BIGINT_BENCH(name, expr)                                                                     \
+    if (bench::selected(settings, name))                                                             \
+    {                                                                                                \
+        results.push_back(bench::run(name, bits, settings, [&]() { res = expr; bench::do_not_optimize(res); })); \
+        bench::print(results.back());                                                                \
+    }
+
+    BIGINT_BENCH("operator+", a + b);
+    BIGINT_BENCH("operator-", a - b);
+    BIGINT_BENCH("operator*", a * b);
+    BIGINT_BENCH("operator/", wide / m);
+    BIGINT_BENCH("operator%", wide % m);
+    BIGINT_BENCH("operator<<", a << 37);
+    BIGINT_BENCH("operator>>", wide >> 37);
+    BIGINT_BENCH("gcd", a.gcd(b));
+    BIGINT_BENCH("inverse", small.inverse(m));
+    // one Montgomery product with every kernel set the CPU supports
+    for (int k = scalar_kernels; k <= montgomery_kernels::detected(); ++k)
+    {
+        MontgomeryContext<bits> ctx(m, (kernel_set)k);
+        Bigint<bits> x = ctx.to_montgomery(small);
+        BIGINT_BENCH(std::string("montgomery_") + montgomery_kernels::name((kernel_set)k), ctx.multiply(x, x));
+    }
+#undef BIGINT_BENCH
+    if (bits > max_exp_width)
+        return;
+    if (bench::selected(settings, "exponentiation"))
+    {
+        results.push_back(bench::run("exponentiation", bits, settings, [&]() { res = small.exponentiation(b, m); bench::do_not_optimize(res); }));
+        bench::print(results.back());
+    }
+    if (bench::selected(settings, "exponentiation_barrett"))
+    {
+        results.push_back(bench::run("exponentiation_barrett", bits, settings, [&]() { res = small.exponentiation(b, m, barrett_reduction); bench::do_not_optimize(res); }));
+        bench::print(results.back());
+    }
+    // a random odd candidate, like the ones rejected during key generation
+    if (bench::selected(settings, "prime_check"))
+    {
+        results.push_back(bench::run("prime_check", bits, settings, [&]() { flag = m.prime_check(); bench::do_not_optimize(flag); }));
+        bench::print(results.back());
+    }
+}
+
+int main(int argc, char **argv)
+{
+    bench::Settings settings;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (bench::parse_setting(argc, argv, i, settings))
+            continue;
+        if (!std::strcmp(argv[i], "--max-width") && i + 1 < argc)
+            max_width = std::atoi(argv[++i]);
+        else if (!std::strcmp(argv[i], "--max-exp-width") && i + 1 < argc)
+            max_exp_width = std::atoi(argv[++i]);
+        else
+        {
+            std::cerr << "unknown argument: " << argv[i] << std::endl;
+            return 1;
+        }
+    }
+    std::vector<bench::Result> results;
+    bench::print_header();
+    run_width<64>(settings, results);
+    run_width<128>(settings, results);
+    run_width<256>(settings, results);
+    run_width<512>(settings, results);
+    run_width<1024>(settings, results);
+    run_width<2048>(settings, results);
+    run_width<4096>(settings, results);
+    run_width<8192>(settings, results);
+    if (!settings.json.empty() && !bench::write_json(settings.json, results))
+    {
+        std::cerr << "cannot write " << settings.json << std::endl;
+        return 1;
+    }
+    return 0;
+}
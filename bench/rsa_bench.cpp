@@ -0,0 +1,198 @@
+/**
+ * End-to-end RSA benchmark: key generation, Message encryption and decryption with realistic payloads.
+ * Usage: rsa_bench [--json file] [--seed n] [--keys n] [--tokens n] [--records n] [--blobs n] [--threads n]
+ *        rsa_bench --compare old.json new.json [--threshold percent]
+ * The compare mode works with the JSON files of bigint_bench too, it exits with 1 if there are regressions.
+ * Payloads: tokens are 32 bytes, records are 4 KB, blobs are 1 MB of random printable characters.
+ * With the same --seed the keys and the payloads are the same in every run.
+ */
+
+#include <iostream>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+#include "bench.h"
+#include "../message.h"
+
+typedef std::chrono::steady_clock bench_clock;
+
+static double elapsed_ns(const bench_clock::time_point &start, const bench_clock::time_point &stop)
+{
+    return std::chrono::duration<double, std::nano>(stop - start).count();
+}
+
+/**
+ * Prints the samples (in nanoseconds) in power of 2 microsecond buckets.
+ */
+static void print_histogram(const std::string &name, const std::vector<double> &samples)
+{
+    std::vector<size_t> buckets;
+    for (size_t i = 0; i < samples.size(); ++i)
+    {
+        size_t b = 0;
+        for (double us = samples[i] / 1000; us >= 1 && b < 40; us /= 2)
+            ++b;
+        if (buckets.size() <= b)
+            buckets.resize(b + 1);
+        ++buckets[b];
+    }
+    std::printf("  %s latency histogram:\n", name.c_str());
+    for (size_t b = 0; b < buckets.size(); ++b)
+    {
+        if (buckets[b] == 0)
+            continue;
+        std::printf("    < %10.0f us %8zu ", b == 0 ? 1.0 : (double)(1ULL << b), buckets[b]);
+        for (size_t i = 0; i < buckets[b] * 50 / samples.size(); ++i)
+            std::putchar('#');
+        std::putchar('\n');
+    }
+}
+
+static void print_result(const bench::Result &r)
+{
+    std::printf("%-16s %9u %6u %14.1f %14.1f %12.1f %14.1f\n", r.name.c_str(), r.width, r.repetitions,
+                r.median / 1000, r.p99 / 1000, r.calls_per_second, r.bytes_per_second);
+    std::fflush(stdout);
+}
+
+/**
+ * @return a random printable string, the characters are drawn from the engine
+ */
+static std::string payload(std::mt19937 &engine, const size_t &size)
+{
+    std::string res(size, ' ');
+    for (size_t i = 0; i < size; ++i)
+        res[i] = (char)(' ' + engine() % 95);
+    return res;
+}
+
+/**
+ * Encrypts and decrypts count random payloads of the given size, every call is timed separately.
+ */
+static void run_payload(const std::string &name, const size_t &size, const unsigned int &count, const RsaKeyPair &keys,
+                        ThreadPool *pool, std::mt19937 &engine, std::vector<bench::Result> &results)
+{
+    if (count == 0)
+        return;
+    std::vector<double> encrypt_samples, decrypt_samples;
+    double encrypt_total = 0, decrypt_total = 0;
+    for (unsigned int i = 0; i < count; ++i)
+    {
+        Message text(payload(engine, size));
+        bench_clock::time_point start = bench_clock::now();
+        if (pool != NULL)
+            text.encrypt(keys.public_key, *pool);
+        else
+            text.encrypt(keys.public_key);
+        bench_clock::time_point middle = bench_clock::now();
+        if (pool != NULL)
+            text.decrypt(keys.private_key, *pool);
+        else
+            text.decrypt(keys.private_key);
+        bench_clock::time_point stop = bench_clock::now();
+        encrypt_samples.push_back(elapsed_ns(start, middle));
+        decrypt_samples.push_back(elapsed_ns(middle, stop));
+        encrypt_total += encrypt_samples.back();
+        decrypt_total += decrypt_samples.back();
+    }
+    bench::Result r = bench::summarize("encrypt/" + name, size, encrypt_samples);
+    r.calls_per_second = count / (encrypt_total / 1e9);
+    r.bytes_per_second = r.calls_per_second * size;
+    results.push_back(r);
+    print_result(r);
+    r = bench::summarize("decrypt/" + name, size, decrypt_samples);
+    r.calls_per_second = count / (decrypt_total / 1e9);
+    r.bytes_per_second = r.calls_per_second * size;
+    results.push_back(r);
+    print_result(r);
+    print_histogram("encrypt/" + name, encrypt_samples);
+    print_histogram("decrypt/" + name, decrypt_samples);
+}
+
+int main(int argc, char **argv)
+{
+    bench::Settings settings;
+    unsigned int seed = std::random_device()();
+    unsigned int keys_count = 5, tokens = 200, records = 10, blobs = 1, threads = 0;
+    double threshold = 5;
+    std::string compare_old, compare_new;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (bench::parse_setting(argc, argv, i, settings))
+            continue;
+        if (!std::strcmp(argv[i], "--seed") && i + 1 < argc)
+            seed = std::strtoul(argv[++i], NULL, 10);
+        else if (!std::strcmp(argv[i], "--keys") && i + 1 < argc)
+            keys_count = std::atoi(argv[++i]);
+        else if (!std::strcmp(argv[i], "--tokens") && i + 1 < argc)
+            tokens = std::atoi(argv[++i]);
+        else if (!std::strcmp(argv[i], "--records") && i + 1 < argc)
+            records = std::atoi(argv[++i]);
+        else if (!std::strcmp(argv[i], "--blobs") && i + 1 < argc)
+            blobs = std::atoi(argv[++i]);
+        else if (!std::strcmp(argv[i], "--threads") && i + 1 < argc)
+            threads = std::atoi(argv[++i]);
+        else if (!std::strcmp(argv[i], "--threshold") && i + 1 < argc)
+            threshold = std::atof(argv[++i]);
+        else if (!std::strcmp(argv[i], "--compare") && i + 2 < argc)
+        {
+            compare_old = argv[++i];
+            compare_new = argv[++i];
+        }
+        else
+        {
+            std::cerr << "unknown argument: " << argv[i] << std::endl;
+            return 1;
+        }
+    }
+    if (!compare_old.empty())
+    {
+        int regressions = bench::compare(compare_old, compare_new, threshold);
+        if (regressions < 0)
+        {
+            std::cerr << "cannot read " << compare_old << " or " << compare_new << std::endl;
+            return 2;
+        }
+        std::printf("%d regression(s) above %.1f%%\n", regressions, threshold);
+        return regressions != 0;
+    }
+
+    std::printf("seed: %u\n", seed);
+    std::mt19937 engine(seed);
+    std::vector<bench::Result> results;
+    ThreadPool *pool = threads > 1 ? new ThreadPool(threads) : NULL;
+    std::printf("%-16s %9s %6s %14s %14s %12s %14s\n", "benchmark", "bytes", "calls", "median (us)", "p99 (us)", "calls/s", "bytes/s");
+
+    // key generation, every key pair is generated from the seeded engine
+    std::vector<double> keygen_samples;
+    RsaKeyPair *keys = NULL;
+    for (unsigned int i = 0; i < (keys_count != 0 ? keys_count : 1); ++i)
+    {
+        bench_clock::time_point start = bench_clock::now();
+        RsaKeyPair *generated = new RsaKeyPair(engine);
+        keygen_samples.push_back(elapsed_ns(start, bench_clock::now()));
+        if (keys == NULL)
+            keys = generated;
+        else
+            delete generated;
+    }
+    bench::Result r = bench::summarize("keygen", key_size, keygen_samples);
+    results.push_back(r);
+    print_result(r);
+    std::printf("  keygen min %.1f ms, median %.1f ms, mean %.1f ms, p99 %.1f ms\n", r.min / 1e6, r.median / 1e6, r.mean / 1e6, r.p99 / 1e6);
+    print_histogram("keygen", keygen_samples);
+
+    run_payload("token", 32, tokens, *keys, pool, engine, results);
+    run_payload("record", 4096, records, *keys, pool, engine, results);
+    run_payload("blob", 1 << 20, blobs, *keys, pool, engine, results);
+
+    delete keys;
+    delete pool;
+    if (!settings.json.empty() && !bench::write_json(settings.json, results))
+    {
+        std::cerr << "cannot write " << settings.json << std::endl;
+        return 1;
+    }
+    return 0;
+}
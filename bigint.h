@@ -2,10 +2,17 @@
 #define BIGINT_H
 
 #include <exception>
+#include <stdexcept>
 #include <cctype>
+#include <cstring>
 #include <iostream>
 #include <iomanip>
 #include <random>
+#include "bigint_constant.h"
+#include "bigint_pool.h"
+#include "bigint_stats.h"
+#include "mpn.h"
+#include "scratch_arena.h"
 #include "memtrace.h"
 
 /**
@@ -25,11 +32,29 @@ bool string_check(const char *x)
     return true;
 }
 
+/**
+ * Selects how Bigint::exponentiation reduces the intermediate products.
+ */
+enum reduction_mode
+{
+    // bit-serial operator%, the products have to fit into bits
+    division_reduction,
+    // a BarrettContext built for the call, the products are kept at double width
+    barrett_reduction,
+};
+
+template <unsigned int bits>
+struct BarrettContext;
+
+template <unsigned int bits, typename Allocator>
+struct BigintProduct;
+
 /**
  * @tparam bits the number of bits used for storage.
  * If bits % 32 != 0: it will be rounded downwards to the nearest multiple of 32.
+ * @tparam Allocator where the storage comes from, see bigint_pool.h
  */
-template <unsigned int bits = 64>
+template <unsigned int bits = 64, typename Allocator = BigintDefaultAllocator>
 struct Bigint
 {
     // stores the number in a little-endian order
@@ -38,9 +63,18 @@ struct Bigint
     //
     Bigint(const char *const &);
     Bigint(const Bigint &);
+    // copies a number stored by another allocator
+    template <typename Other>
+    Bigint(const Bigint<bits, Other> &);
+    // copies a compile-time constant, e.g. Bigint<256> c = 0x10001_big
+    template <unsigned int other>
+    Bigint(const BigintConstant<other> &);
     Bigint &operator=(const Bigint &);
     // randomizes the number up to (input/32) bits
     void rng(const unsigned int & = 0);
+    // randomizes the number with the given random number engine, e.g. a seeded std::mt19937
+    template <typename Engine>
+    void rng(Engine &, const unsigned int & = 0);
     bool operator==(const Bigint &) const;
     bool operator!=(const Bigint &) const;
     bool operator<(const Bigint &) const;
@@ -50,8 +84,11 @@ struct Bigint
     bool is_even() const;
     bool is_odd() const;
     Bigint operator+(const Bigint &) const;
+    // a + b * c, the product is accumulated into the sum without a temporary
+    Bigint operator+(BigintProduct<bits, Allocator> &&) const;
     Bigint operator-(const Bigint &) const;
-    Bigint operator*(const Bigint &) const;
+    // the product is evaluated when it's converted to a Bigint, or fused with the next operator
+    BigintProduct<bits, Allocator> operator*(const Bigint &) const;
     Bigint operator/(const Bigint &) const;
     Bigint operator%(const Bigint &) const;
     Bigint operator<<(const unsigned int &) const;
@@ -60,7 +97,7 @@ struct Bigint
     // greatest common divisor
     Bigint gcd(const Bigint &) const;
     // modular exponentiation
-    Bigint exponentiation(const Bigint<bits> &, const Bigint<bits> &) const;
+    Bigint exponentiation(const Bigint &, const Bigint &, const reduction_mode & = division_reduction) const;
     // modular multiplicative inverse
     Bigint inverse(const Bigint &) const;
     // Fermat primality test
@@ -71,10 +108,12 @@ struct Bigint
 /**
  * @param x a 64 bit integer.
  */
-template <unsigned int bits>
-Bigint<bits>::Bigint(const unsigned long long &x)
+template <unsigned int bits, typename Allocator>
+Bigint<bits, Allocator>::Bigint(const unsigned long long &x)
 {
-    storage = new unsigned int[bits / (sizeof(unsigned int) * 8)]{0};
+    storage = Allocator::template allocate<bits / (sizeof(unsigned int) * 8)>();
+    std::memset(storage, 0, bits / 8);
+    BIGINT_COUNT_ALLOCATION(bits);
     storage[0] = x;
     storage[1] = x >> (sizeof(unsigned int) * 8);
 }
@@ -83,12 +122,14 @@ Bigint<bits>::Bigint(const unsigned long long &x)
  * @param x C string with a '\0' null terminator.
  * It may only consist a hexadecimal number (letter capitalization doesn't matter).
  */
-template <unsigned int bits>
-Bigint<bits>::Bigint(const char *const &x)
+template <unsigned int bits, typename Allocator>
+Bigint<bits, Allocator>::Bigint(const char *const &x)
 {
     if (!string_check(x))
         throw std::domain_error("found non-hexadecimal character in input string");
-    storage = new unsigned int[bits / (sizeof(unsigned int) * 8)]{0};
+    storage = Allocator::template allocate<bits / (sizeof(unsigned int) * 8)>();
+    std::memset(storage, 0, bits / 8);
+    BIGINT_COUNT_ALLOCATION(bits);
     unsigned short number_of_runs = strlen(x) / 8;
     // a run consists of reading 8 hexadecimal digits enough to fill 32 bits
     if (number_of_runs > 1)
@@ -112,20 +153,49 @@ Bigint<bits>::Bigint(const char *const &x)
         sscanf(x, "%X", &storage[0]);
 }
 
-template <unsigned int bits>
-Bigint<bits>::Bigint(const Bigint &x)
+template <unsigned int bits, typename Allocator>
+Bigint<bits, Allocator>::Bigint(const Bigint &x)
 {
-    storage = new unsigned int[bits / (sizeof(unsigned int) * 8)];
+    storage = Allocator::template allocate<bits / (sizeof(unsigned int) * 8)>();
+    BIGINT_COUNT_ALLOCATION(bits);
     std::memcpy(storage, x.storage, bits / 8);
 }
 
-template <unsigned int bits>
-Bigint<bits> &Bigint<bits>::operator=(const Bigint &x)
+/**
+ * @param x the same number, its storage is freed by its own allocator
+ */
+template <unsigned int bits, typename Allocator>
+template <typename Other>
+Bigint<bits, Allocator>::Bigint(const Bigint<bits, Other> &x)
+{
+    storage = Allocator::template allocate<bits / (sizeof(unsigned int) * 8)>();
+    BIGINT_COUNT_ALLOCATION(bits);
+    std::memcpy(storage, x.storage, bits / 8);
+}
+
+/**
+ * @param x zero-extended, or truncated if it's wider than bits
+ */
+template <unsigned int bits, typename Allocator>
+template <unsigned int other>
+Bigint<bits, Allocator>::Bigint(const BigintConstant<other> &x)
+{
+    storage = Allocator::template allocate<bits / (sizeof(unsigned int) * 8)>();
+    std::memset(storage, 0, bits / 8);
+    BIGINT_COUNT_ALLOCATION(bits);
+    for (unsigned int i = 0; i < bits / (sizeof(unsigned int) * 8) && i < BigintConstant<other>::n; ++i)
+        storage[i] = x.storage[i];
+}
+
+template <unsigned int bits, typename Allocator>
+Bigint<bits, Allocator> &Bigint<bits, Allocator>::operator=(const Bigint &x)
 {
     if (this != &x)
     {
-        delete[] storage;
-        storage = new unsigned int[bits / (sizeof(unsigned int) * 8)];
+        Allocator::template deallocate<bits / (sizeof(unsigned int) * 8)>(storage);
+        BIGINT_COUNT(op_deallocation, bits);
+        storage = Allocator::template allocate<bits / (sizeof(unsigned int) * 8)>();
+        BIGINT_COUNT_ALLOCATION(bits);
         std::memcpy(storage, x.storage, bits / 8);
     }
     return *this;
@@ -137,16 +207,28 @@ Bigint<bits> &Bigint<bits>::operator=(const Bigint &x)
  * @return randomized output (size in bits = size_max/32) using std::random_device.
  * Not that std::random_device may produce deterministic results depending on the device!
  */
-template <unsigned int bits>
-void Bigint<bits>::rng(const unsigned int &size_max)
+template <unsigned int bits, typename Allocator>
+void Bigint<bits, Allocator>::rng(const unsigned int &size_max)
 {
     std::random_device rd;
+    rng(rd, size_max);
+}
+
+/**
+ * @param engine a random number engine producing 32 bit numbers
+ * @param size_max upper limit of randomization in terms of bit size.
+ * If (size_max = 0) => the entire size of its storage will be randomized
+ */
+template <unsigned int bits, typename Allocator>
+template <typename Engine>
+void Bigint<bits, Allocator>::rng(Engine &engine, const unsigned int &size_max)
+{
     if (size_max == 0)
     {
         unsigned int n = bits / (sizeof(unsigned int) * 8);
         for (unsigned short i = 0; i < n; ++i)
         {
-            this->storage[i] = rd();
+            this->storage[i] = engine();
         }
     }
     else
@@ -154,72 +236,67 @@ void Bigint<bits>::rng(const unsigned int &size_max)
         unsigned int n = size_max / (sizeof(unsigned int) * 8);
         for (unsigned short i = 0; i < n; ++i)
         {
-            this->storage[i] = rd();
+            this->storage[i] = engine();
         }
     }
 }
 
-template <unsigned int bits>
-bool Bigint<bits>::operator==(const Bigint &x) const
+template <unsigned int bits, typename Allocator>
+bool Bigint<bits, Allocator>::operator==(const Bigint &x) const
 {
-    for (unsigned int i = 0; i < bits / (sizeof(unsigned int) * 8); ++i)
-    {
-        // if any element of the array doesn't match they're not equal
-        if (storage[i] != x.storage[i])
-            return false;
-    }
-    return true;
+    return mpn::cmp(storage, x.storage, bits / (sizeof(unsigned int) * 8)) == 0;
 }
 
-template <unsigned int bits>
-bool Bigint<bits>::operator!=(const Bigint &x) const
+template <unsigned int bits, typename Allocator>
+bool Bigint<bits, Allocator>::operator!=(const Bigint &x) const
 {
-    for (unsigned int i = 0; i < bits / (sizeof(unsigned int) * 8); ++i)
-    {
-        // if any element of the array doesn't match they're not equal
-        if (storage[i] != x.storage[i])
-            return true;
-    }
-    return false;
+    return mpn::cmp(storage, x.storage, bits / (sizeof(unsigned int) * 8)) != 0;
 }
 
-template <unsigned int bits>
-bool Bigint<bits>::operator<(const Bigint &x) const
+template <unsigned int bits, typename Allocator>
+bool Bigint<bits, Allocator>::operator<(const Bigint &x) const
 {
-    // start the loop from the MSB
-    for (int i = bits / (sizeof(unsigned int) * 8) - 1; i >= 0; --i)
-    {
-        // the first non-zero element will determine the return value
-        if (storage[i] != 0 || x.storage[i] != 0)
-        {
-            return storage[i] < x.storage[i];
-        }
-    }
-    // if the inputs are 0 it will return false
-    return false;
+    return mpn::cmp(storage, x.storage, bits / (sizeof(unsigned int) * 8)) < 0;
 }
 
-template <unsigned int bits>
-bool Bigint<bits>::operator>(const Bigint &x) const
+template <unsigned int bits, typename Allocator>
+bool Bigint<bits, Allocator>::operator>(const Bigint &x) const
+{
+    return mpn::cmp(storage, x.storage, bits / (sizeof(unsigned int) * 8)) > 0;
+}
+
+/**
+ * Compares with a constant without converting it to a Bigint, the shorter one is zero-extended.
+ * @return -1, 0 or 1 if x is less than, equal to or greater than c
+ */
+template <unsigned int bits, typename Allocator, unsigned int other>
+int compare(const Bigint<bits, Allocator> &x, const BigintConstant<other> &c)
 {
-    // start the loop from MSB
-    for (int i = bits / (sizeof(unsigned int) * 8) - 1; i >= 0; --i)
+    const unsigned int n = bits / (sizeof(unsigned int) * 8);
+    for (unsigned int i = n > BigintConstant<other>::n ? n : BigintConstant<other>::n; i > 0; --i)
     {
-        // the first non-zero element will determine the return value
-        if (storage[i] != 0 || x.storage[i] != 0)
-        {
-            return storage[i] > x.storage[i];
-        }
+        unsigned int a = i <= n ? x.storage[i - 1] : 0;
+        unsigned int b = i <= BigintConstant<other>::n ? c.storage[i - 1] : 0;
+        if (a != b)
+            return a < b ? -1 : 1;
     }
-    // if the inputs are 0 it will return false
-    return false;
+    return 0;
 }
 
+template <unsigned int bits, typename Allocator, unsigned int other>
+bool operator==(const Bigint<bits, Allocator> &x, const BigintConstant<other> &c) { return compare(x, c) == 0; }
+template <unsigned int bits, typename Allocator, unsigned int other>
+bool operator!=(const Bigint<bits, Allocator> &x, const BigintConstant<other> &c) { return compare(x, c) != 0; }
+template <unsigned int bits, typename Allocator, unsigned int other>
+bool operator<(const Bigint<bits, Allocator> &x, const BigintConstant<other> &c) { return compare(x, c) < 0; }
+template <unsigned int bits, typename Allocator, unsigned int other>
+bool operator>(const Bigint<bits, Allocator> &x, const BigintConstant<other> &c) { return compare(x, c) > 0; }
+
 /**
  * @return the number of bits sufficient to represent *this
  */
-template <unsigned int bits>
-unsigned int Bigint<bits>::num_bits() const
+template <unsigned int bits, typename Allocator>
+unsigned int Bigint<bits, Allocator>::num_bits() const
 {
     unsigned int i = bits / (sizeof(unsigned int) * 8) - 1;
     // i will be equal to the amount of array elements that are zero starting from MSB
@@ -228,206 +305,140 @@ unsigned int Bigint<bits>::num_bits() const
     return storage[i] == 0 ? i * 8 * sizeof(unsigned int) : (i + 1) * 8 * sizeof(unsigned int) - __builtin_clz(storage[i]);
 }
 
-template <unsigned int bits>
-bool Bigint<bits>::is_even() const
+template <unsigned int bits, typename Allocator>
+bool Bigint<bits, Allocator>::is_even() const
 {
     // check LSB
     return !(this->storage[0] & 1);
 }
 
-template <unsigned int bits>
-bool Bigint<bits>::is_odd() const
+template <unsigned int bits, typename Allocator>
+bool Bigint<bits, Allocator>::is_odd() const
 {
     // check LSB
     return this->storage[0] & 1;
 }
 
-template <unsigned int bits>
-Bigint<bits> Bigint<bits>::operator+(const Bigint &x) const
+template <unsigned int bits, typename Allocator>
+Bigint<bits, Allocator> Bigint<bits, Allocator>::operator+(const Bigint &x) const
 {
+    BIGINT_COUNT(op_addition, bits);
     Bigint res;
-    unsigned int carry = 0;
-    unsigned long long temp;
-    for (unsigned int i = 0; i < bits / (sizeof(unsigned int) * 8); ++i)
-    {
-        // add together the current array elements of both inputs and the last carry
-        temp = (unsigned long long)storage[i] + (unsigned long long)x.storage[i] + (unsigned long long)carry;
-        // the carry will be the upper half of the unsigned long long integer
-        // so we shift it down by that amount
-        carry = temp >> (8 * sizeof(unsigned int));
-        res.storage[i] = (unsigned int)temp;
-    }
+    // the carry out of the top is dropped, the sum overflows like an unsigned integer
+    mpn::add_n(res.storage, storage, x.storage, bits / (sizeof(unsigned int) * 8));
     return res;
 }
 
-template <unsigned int bits>
-Bigint<bits> Bigint<bits>::operator-(const Bigint &x) const
+template <unsigned int bits, typename Allocator>
+Bigint<bits, Allocator> Bigint<bits, Allocator>::operator-(const Bigint &x) const
 {
+    BIGINT_COUNT(op_subtraction, bits);
     Bigint res;
-    unsigned int borrow = 0;
-    unsigned long long temp;
-    for (unsigned int i = 0; i < bits / (sizeof(unsigned int) * 8); ++i)
-    {
-        // subtract the inputs and add the last borrow
-        temp = (unsigned long long)storage[i] - ((unsigned long long)x.storage[i] + (unsigned long long)borrow);
-        borrow = temp >> (8 * sizeof(unsigned long long) - 1);
-        res.storage[i] = (unsigned int)temp;
-    }
+    mpn::sub_n(res.storage, storage, x.storage, bits / (sizeof(unsigned int) * 8));
     return res;
 }
 
 /**
- * This multiplication uses the classic schoolbook multiplication method
- * @return The return value will be the same size as the inputs, it will overflow
+ * This multiplication uses the classic schoolbook multiplication method, see BigintProduct
+ * @return The product will be the same size as the inputs, it will overflow
  * if the numbers are too big. Choose sufficiently large inputs ensuring it won't overflow.
  */
-template <unsigned int bits>
-Bigint<bits> Bigint<bits>::operator*(const Bigint &x) const
+template <unsigned int bits, typename Allocator>
+BigintProduct<bits, Allocator> Bigint<bits, Allocator>::operator*(const Bigint &x) const
 {
-    Bigint res;
-    unsigned long long carry = 0;
-    unsigned short k = 0;
-    unsigned long long temp;
-    for (unsigned int i = 0; i < bits / (sizeof(unsigned int) * 8); ++i)
-    {
-        carry = 0;
-        for (unsigned int j = 0; j < bits / (sizeof(unsigned int) * 8); ++j)
-        {
-            k = i + j;
-            if (k < bits / (sizeof(unsigned int) * 8))
-            {
-                temp = (unsigned long long)res.storage[k] + (unsigned long long)storage[i] * (unsigned long long)x.storage[j] + (unsigned long long)carry;
-                res.storage[k] = (unsigned int)temp;
-                carry = temp >> (8 * sizeof(unsigned int));
-            }
-            else
-                break;
-        }
-    }
+    return BigintProduct<bits, Allocator>(*this, x);
+}
+
+/**
+ * Multiply-accumulate: the rows of the product are added to a copy of this.
+ * @return this + x.a * x.b, the same as the sum with the evaluated product
+ */
+template <unsigned int bits, typename Allocator>
+Bigint<bits, Allocator> Bigint<bits, Allocator>::operator+(BigintProduct<bits, Allocator> &&x) const
+{
+    BIGINT_COUNT(op_multiplication, bits);
+    BIGINT_COUNT(op_addition, bits);
+    Bigint res(*this);
+    const unsigned int n = bits / (sizeof(unsigned int) * 8);
+    // every row is shortened like in the product, the carries out of the top are dropped
+    for (unsigned int i = 0; i < n; ++i)
+        if (x.a.storage[i] != 0)
+            mpn::addmul_1(res.storage + i, x.b.storage, n - i, x.a.storage[i]);
     return res;
 }
 
-template <unsigned int bits>
-Bigint<bits> Bigint<bits>::operator/(const Bigint &x) const
+/**
+ * Schoolbook long division with a quotient estimate for every limb (mpn::divrem).
+ * @param x the divisor, it can't be 0
+ * @return the quotient rounded downwards
+ */
+template <unsigned int bits, typename Allocator>
+Bigint<bits, Allocator> Bigint<bits, Allocator>::operator/(const Bigint &x) const
 {
-    if (*this < x)
-        return *this;
-    unsigned int bd = this->num_bits() - x.num_bits();
-    Bigint rem(*this);
+    BIGINT_COUNT(op_division, bits);
+    const unsigned int n = bits / (sizeof(unsigned int) * 8);
+    unsigned int dn = mpn::size(x.storage, n);
+    if (dn == 0)
+        throw std::domain_error("division by zero");
+    unsigned int nn = mpn::size(storage, n);
     Bigint quo;
-    Bigint c(x);
-    Bigint e(1);
-    c = c << bd;
-    e = e << bd;
-    // MSB of storage
-    unsigned int ms_part = bits / (sizeof(unsigned int) * 8) - 1;
-    // 31 bits
-    unsigned int bitsize_m_1 = (sizeof(unsigned int) * 8) - 1;
-    Bigint r;
-    while (true)
-    {
-        r = rem - c;
-        unsigned int d = 1 - (r.storage[ms_part] >> bitsize_m_1);
-        if (d != 0)
-        {
-            rem = r;
-            r = quo + e;
-            quo = r;
-        }
-        if (bd-- == 0)
-            break;
-        c = c >> 1;
-        e = e >> 1;
-    }
+    if (nn < dn)
+        return quo;
+    ScratchArray<2 * (bits / (sizeof(unsigned int) * 8)) + 1> scratch(nn + dn + 1);
+    mpn::divrem(quo.storage, nullptr, storage, nn, x.storage, dn, scratch.limbs());
     return quo;
 }
 
 /**
  * uses the same algorithm as division but returns the remainder
+ * @param x the divisor, it can't be 0
  */
-template <unsigned int bits>
-Bigint<bits> Bigint<bits>::operator%(const Bigint &x) const
+template <unsigned int bits, typename Allocator>
+Bigint<bits, Allocator> Bigint<bits, Allocator>::operator%(const Bigint &x) const
 {
-    if (*this < x)
+    BIGINT_COUNT(op_modulo, bits);
+    const unsigned int n = bits / (sizeof(unsigned int) * 8);
+    unsigned int dn = mpn::size(x.storage, n);
+    if (dn == 0)
+        throw std::domain_error("division by zero");
+    unsigned int nn = mpn::size(storage, n);
+    if (nn < dn)
         return *this;
-    unsigned int bd = this->num_bits() - x.num_bits();
-    Bigint rem(*this);
-    Bigint c(x);
-    c = c << bd;
-    unsigned int ms_part = bits / (sizeof(unsigned int) * 8) - 1;
-    unsigned int bitsize_m_1 = (sizeof(unsigned int) * 8) - 1;
-    Bigint r;
-    while (true)
-    {
-        r = rem - c;
-        unsigned int d = r.storage[ms_part] >> bitsize_m_1;
-        if (d == 0)
-            rem = r;
-        if (bd-- == 0)
-            break;
-        c = c >> 1;
-    }
+    Bigint rem;
+    ScratchArray<2 * (bits / (sizeof(unsigned int) * 8)) + 1> scratch(nn + dn + 1);
+    mpn::divrem(nullptr, rem.storage, storage, nn, x.storage, dn, scratch.limbs());
     return rem;
 }
 
-template <unsigned int bits>
-Bigint<bits> Bigint<bits>::operator<<(const unsigned int &shift) const
+template <unsigned int bits, typename Allocator>
+Bigint<bits, Allocator> Bigint<bits, Allocator>::operator<<(const unsigned int &shift) const
 {
+    BIGINT_COUNT(op_shift_left, bits);
     if (shift >= bits)
         return Bigint();
     Bigint ret;
     unsigned int full_shifts = shift / (sizeof(unsigned int) * 8);
-    unsigned int lshift = shift % (sizeof(unsigned int) * 8);
-    unsigned int rshift = sizeof(unsigned int) * 8 - lshift;
-    if (lshift == 0)
-    {
-        for (unsigned int i = bits / (sizeof(unsigned int) * 8) - 1; i > full_shifts; --i)
-            ret.storage[i] = storage[i - full_shifts] << lshift;
-    }
-    else
-    {
-        for (unsigned int i = bits / (sizeof(unsigned int) * 8) - 1; i > full_shifts; --i)
-        {
-            unsigned int lo = storage[i - full_shifts] << lshift;
-            lo |= storage[i - full_shifts - 1] >> rshift;
-            ret.storage[i] = lo;
-        }
-    }
-    ret.storage[full_shifts] = storage[0] << lshift;
+    mpn::lshift(ret.storage + full_shifts, storage, bits / (sizeof(unsigned int) * 8) - full_shifts, shift % (sizeof(unsigned int) * 8));
     return ret;
 }
 
-template <unsigned int bits>
-Bigint<bits> Bigint<bits>::operator>>(const unsigned int &shift) const
+template <unsigned int bits, typename Allocator>
+Bigint<bits, Allocator> Bigint<bits, Allocator>::operator>>(const unsigned int &shift) const
 {
+    BIGINT_COUNT(op_shift_right, bits);
     if (shift >= bits)
         return Bigint();
     Bigint ret;
     unsigned int full_shifts = shift / (sizeof(unsigned int) * 8);
-    unsigned int small_shift = shift & ((sizeof(unsigned int) * 8) - 1);
-    unsigned int n = bits / (sizeof(unsigned int) * 8) - full_shifts;
-    if (small_shift == 0)
-    {
-        for (unsigned int i = 0; i < n; ++i)
-            ret.storage[i] = storage[i + full_shifts];
-    }
-    else
-    {
-        for (unsigned int i = 0; i < n - 1; ++i)
-        {
-            unsigned int lo = storage[i + full_shifts] >> small_shift;
-            lo |= storage[i + full_shifts + 1] << (sizeof(unsigned int) * 8 - small_shift);
-            ret.storage[i] = lo;
-        }
-        ret.storage[n - 1] = storage[n - 1 + full_shifts] >> small_shift;
-    }
+    mpn::rshift(ret.storage, storage + full_shifts, bits / (sizeof(unsigned int) * 8) - full_shifts, shift % (sizeof(unsigned int) * 8));
     return ret;
 }
 
-template <unsigned int bits>
-Bigint<bits>::~Bigint()
+template <unsigned int bits, typename Allocator>
+Bigint<bits, Allocator>::~Bigint()
 {
-    delete[] storage;
+    Allocator::template deallocate<bits / (sizeof(unsigned int) * 8)>(storage);
+    BIGINT_COUNT(op_deallocation, bits);
 }
 
 /**
@@ -436,13 +447,14 @@ Bigint<bits>::~Bigint()
  * @param a
  * @return Greatest common divisor of a and b.
  */
-template <unsigned int bits>
-Bigint<bits> Bigint<bits>::gcd(const Bigint &b) const
+template <unsigned int bits, typename Allocator>
+Bigint<bits, Allocator> Bigint<bits, Allocator>::gcd(const Bigint &b) const
 {
+    BIGINT_COUNT(op_gcd, bits);
     Bigint a = *this;
     Bigint b_temp = b;
     Bigint temp;
-    const Bigint null;
+    constexpr BigintConstant<bits> null;
     while (b_temp != null)
     {
         temp = b_temp;
@@ -454,27 +466,45 @@ Bigint<bits> Bigint<bits>::gcd(const Bigint &b) const
 
 /**
  * Modular exponentiation algorithm.
+ * The products are kept at double width in scratch limbs and reduced with mpn::divrem,
+ * so they don't have to fit into bits.
  * @tparam bits number of bits used to store the integers, usually ommited in functions calls.
- * @param a must be less than m
+ * @param a the base, it's reduced first if it's not less than m
  * @param b must be greater than 0
- * @param m must be larger than a
+ * @param m can't be 0
+ * @param mode barrett_reduction computes the reciprocal of m once and reduces without division
  * @return aˆb % m
  */
-template <unsigned int bits>
-Bigint<bits> Bigint<bits>::exponentiation(const Bigint &b, const Bigint &m) const
+template <unsigned int bits, typename Allocator>
+Bigint<bits, Allocator> Bigint<bits, Allocator>::exponentiation(const Bigint &b, const Bigint &m, const reduction_mode &mode) const
 {
-    Bigint a = *this;
-    Bigint b_temp = b;
+    BIGINT_COUNT(op_exponentiation, bits);
+    if (mode == barrett_reduction)
+        return BarrettContext<bits>(m).exponentiation(*this, b);
+    const unsigned int n = bits / (sizeof(unsigned int) * 8);
+    unsigned int mn = mpn::size(m.storage, n);
+    if (mn == 0)
+        throw std::domain_error("division by zero");
+    // every number below is less than m, so it fits into mn limbs
+    Bigint a = *this < m ? *this : *this % m;
     Bigint c(1);
-    const Bigint null;
-    while (b_temp != null)
+    ScratchArray<2 * (bits / (sizeof(unsigned int) * 8))> product_limbs(2 * mn);
+    ScratchArray<3 * (bits / (sizeof(unsigned int) * 8)) + 1> scratch_limbs(3 * mn + 1);
+    unsigned int *product = product_limbs.limbs();
+    unsigned int *scratch = scratch_limbs.limbs();
+    unsigned int top = b.num_bits();
+    for (unsigned int i = 0; i < top; ++i)
     {
-        if (b_temp.is_odd())
+        if ((b.storage[i / (sizeof(unsigned int) * 8)] >> (i % (sizeof(unsigned int) * 8))) & 1)
+        {
+            mpn::mul(product, c.storage, mn, a.storage, mn);
+            mpn::divrem(nullptr, c.storage, product, 2 * mn, m.storage, mn, scratch);
+        }
+        if (i + 1 < top)
         {
-            c = (c * a) % m;
+            mpn::mul(product, a.storage, mn, a.storage, mn);
+            mpn::divrem(nullptr, a.storage, product, 2 * mn, m.storage, mn, scratch);
         }
-        a = (a * a) % m;
-        b_temp = b_temp >> 1;
     }
     return c;
 }
@@ -483,18 +513,23 @@ Bigint<bits> Bigint<bits>::exponentiation(const Bigint &b, const Bigint &m) cons
  * Modular multiplicative inverse algorithm (using extended Euclidean algorithm).
  * A modular multiplicative inverse of an integer a is an integer x such that the product ax is congruent to 1 with respect to the modulus m.
  * @tparam bits number of bits used to store the integers, usually ommited in functions calls.
+ * @param b the modulus, it has to be coprime with *this
  * @return a*t congruent 1 (mod b)
+ * @throw std::domain_error if gcd(*this, b) != 1, the inverse doesn't exist then
+ * (the Euclidean steps reach a zero divisor)
  */
-template <unsigned int bits>
-Bigint<bits> Bigint<bits>::inverse(const Bigint &b) const
+template <unsigned int bits, typename Allocator>
+Bigint<bits, Allocator> Bigint<bits, Allocator>::inverse(const Bigint &b) const
 {
+    BIGINT_COUNT(op_inverse, bits);
     Bigint a = *this;
     Bigint b_temp = b;
     Bigint x0;
     bool x0_sign = false;
     Bigint x1(1);
     bool x1_sign = false;
-    while (a > 1)
+    constexpr BigintConstant<bits> one(1);
+    while (a > one)
     {
         Bigint q(a / b_temp);
         Bigint t = b_temp;
@@ -525,18 +560,21 @@ Bigint<bits> Bigint<bits>::inverse(const Bigint &b) const
  * @param m the integer to test
  * @return True if m is a prime.
  */
-template <unsigned int bits>
-bool Bigint<bits>::prime_check() const
+template <unsigned int bits, typename Allocator>
+bool Bigint<bits, Allocator>::prime_check() const
 {
+    BIGINT_COUNT(op_prime_check, bits);
     Bigint high(*this - 1);
-    const Bigint one(1);
+    constexpr BigintConstant<bits> one(1);
+    // the modulus is the same for every round, so its reciprocal is computed only once
+    const BarrettContext<bits> barrett(*this);
     Bigint a;
     for (unsigned short k = 0; k < 100; ++k)
     {
         a.rng(high.num_bits());
         if (this->gcd(a) != one)
             return false;
-        if (a.exponentiation(high, *this) != one)
+        if (barrett.exponentiation(a, high) != one)
             return false;
     }
     return true;
@@ -546,8 +584,8 @@ bool Bigint<bits>::prime_check() const
  * displays the Bigint in normal ordering with hexadecimal characters
  * @param x the Bigint to display
  */
-template <unsigned int bits>
-std::ostream &operator<<(std::ostream &os, const Bigint<bits> &x)
+template <unsigned int bits, typename Allocator>
+std::ostream &operator<<(std::ostream &os, const Bigint<bits, Allocator> &x)
 {
     unsigned short size = bits / (sizeof(unsigned int) * 8);
     os << std::hex;
@@ -575,4 +613,9 @@ std::ostream &operator<<(std::ostream &os, const Bigint<bits> &x)
     return os;
 }
 
+// BigintProduct is the result of operator*, it needs the complete Bigint
+#include "bigint_expr.h"
+// BarrettContext is used by exponentiation and prime_check, it needs the complete Bigint
+#include "barrett.h"
+
 #endif
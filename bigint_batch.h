@@ -0,0 +1,400 @@
+#ifndef BIGINT_BATCH_H
+#define BIGINT_BATCH_H
+
+#include <cstring>
+#include "bigint.h"
+#include "montgomery.h"
+#include "montgomery_kernels.h"
+#include "memtrace.h"
+
+/**
+ * Lanes independent numbers stored as a structure of arrays: the same limb of every lane is stored together,
+ * so one vector load reads that limb of consecutive lanes.
+ * The limbs are stored inline, a batch never allocates.
+ * @tparam bits number of bits used to store each number
+ * @tparam Lanes number of numbers in the batch
+ */
+template <unsigned int bits, unsigned int Lanes>
+struct BigintBatch
+{
+    static_assert(Lanes > 0, "a batch needs at least one lane");
+    // storage[i][l] is the i-th limb of lane l
+    unsigned int storage[bits / (sizeof(unsigned int) * 8)][Lanes];
+    BigintBatch() : storage{} {}
+    void set(const unsigned int &lane, const Bigint<bits> &x)
+    {
+        for (unsigned int i = 0; i < bits / (sizeof(unsigned int) * 8); ++i)
+            storage[i][lane] = x.storage[i];
+    }
+    Bigint<bits> get(const unsigned int &lane) const
+    {
+        Bigint<bits> res;
+        for (unsigned int i = 0; i < bits / (sizeof(unsigned int) * 8); ++i)
+            res.storage[i] = storage[i][lane];
+        return res;
+    }
+};
+
+namespace montgomery_kernels
+{
+    /**
+     * Lane-parallel CIOS Montgomery multiplication in portable code, the inner loops run over the lanes.
+     * Every lane has its own operands, the modulus is shared.
+     * @param r, a, b limb i of lane l is at [i * stride + l], r may be the same as a or b
+     * @param limbs number of limbs of the modulus
+     */
+    template <unsigned int n, unsigned int lanes>
+    void multiply_lanes_scalar(unsigned int *r, const unsigned int *a, const unsigned int *b, const unsigned int &stride,
+                               const unsigned int *m, const unsigned int &m_prime, const unsigned int &limbs)
+    {
+        unsigned long long t[n + 2][lanes] = {};
+        unsigned long long c[lanes];
+        unsigned long long q[lanes];
+        unsigned long long s;
+        for (unsigned int i = 0; i < limbs; ++i)
+        {
+            for (unsigned int l = 0; l < lanes; ++l)
+                c[l] = 0;
+            for (unsigned int j = 0; j < limbs; ++j)
+                for (unsigned int l = 0; l < lanes; ++l)
+                {
+                    s = t[j][l] + (unsigned long long)a[j * stride + l] * b[i * stride + l] + c[l];
+                    t[j][l] = (unsigned int)s;
+                    c[l] = s >> 32;
+                }
+            for (unsigned int l = 0; l < lanes; ++l)
+            {
+                s = t[limbs][l] + c[l];
+                t[limbs][l] = (unsigned int)s;
+                t[limbs + 1][l] = s >> 32;
+                q[l] = (unsigned int)(t[0][l] * m_prime);
+                c[l] = (t[0][l] + q[l] * m[0]) >> 32;
+            }
+            for (unsigned int j = 1; j < limbs; ++j)
+                for (unsigned int l = 0; l < lanes; ++l)
+                {
+                    s = t[j][l] + q[l] * m[j] + c[l];
+                    t[j - 1][l] = (unsigned int)s;
+                    c[l] = s >> 32;
+                }
+            for (unsigned int l = 0; l < lanes; ++l)
+            {
+                s = t[limbs][l] + c[l];
+                t[limbs - 1][l] = (unsigned int)s;
+                t[limbs][l] = t[limbs + 1][l] + (s >> 32);
+            }
+        }
+        // the results are less than 2 * m, t - m is kept in the lanes where it doesn't borrow out of t[limbs]
+        for (unsigned int l = 0; l < lanes; ++l)
+        {
+            unsigned int d[n];
+            unsigned long long borrow = 0;
+            for (unsigned int j = 0; j < limbs; ++j)
+            {
+                s = t[j][l] - m[j] - borrow;
+                d[j] = (unsigned int)s;
+                borrow = s >> 63;
+            }
+            bool keep_t = t[limbs][l] < borrow;
+            for (unsigned int j = 0; j < limbs; ++j)
+                r[j * stride + l] = keep_t ? (unsigned int)t[j][l] : d[j];
+            for (unsigned int j = limbs; j < n; ++j)
+                r[j * stride + l] = 0;
+        }
+    }
+
+#ifdef MONTGOMERY_X86_KERNELS
+    /**
+     * Lane-parallel CIOS Montgomery multiplication for 4 lanes with AVX2, every limb is in a 64 bit lane.
+     * @param r, a, b limb i of lane l is at [i * stride + l], r may be the same as a or b
+     * @param limbs number of limbs of the modulus
+     */
+    template <unsigned int n>
+    __attribute__((target("avx2"))) void multiply_lanes_avx2(unsigned int *r, const unsigned int *a, const unsigned int *b, const unsigned int &stride,
+                                                             const unsigned int *m, const unsigned int &m_prime, const unsigned int &limbs)
+    {
+        const __m256i mask = _mm256_set1_epi64x(0xFFFFFFFFULL);
+        const __m256i vm_prime = _mm256_set1_epi64x(m_prime);
+        __m256i va[n];
+        __m256i t[n + 2];
+        __m256i c;
+        __m256i s;
+        for (unsigned int j = 0; j < limbs; ++j)
+            va[j] = _mm256_cvtepu32_epi64(_mm_loadu_si128((const __m128i *)(a + j * stride)));
+        for (unsigned int j = 0; j < limbs + 2; ++j)
+            t[j] = _mm256_setzero_si256();
+        for (unsigned int i = 0; i < limbs; ++i)
+        {
+            __m256i vb = _mm256_cvtepu32_epi64(_mm_loadu_si128((const __m128i *)(b + i * stride)));
+            c = _mm256_setzero_si256();
+            for (unsigned int j = 0; j < limbs; ++j)
+            {
+                s = _mm256_add_epi64(_mm256_add_epi64(t[j], _mm256_mul_epu32(va[j], vb)), c);
+                t[j] = _mm256_and_si256(s, mask);
+                c = _mm256_srli_epi64(s, 32);
+            }
+            s = _mm256_add_epi64(t[limbs], c);
+            t[limbs] = _mm256_and_si256(s, mask);
+            t[limbs + 1] = _mm256_srli_epi64(s, 32);
+            // q = t[0] * m_prime mod 2^32 in every lane
+            __m256i q = _mm256_and_si256(_mm256_mul_epu32(t[0], vm_prime), mask);
+            c = _mm256_srli_epi64(_mm256_add_epi64(t[0], _mm256_mul_epu32(q, _mm256_set1_epi64x(m[0]))), 32);
+            for (unsigned int j = 1; j < limbs; ++j)
+            {
+                s = _mm256_add_epi64(_mm256_add_epi64(t[j], _mm256_mul_epu32(q, _mm256_set1_epi64x(m[j]))), c);
+                t[j - 1] = _mm256_and_si256(s, mask);
+                c = _mm256_srli_epi64(s, 32);
+            }
+            s = _mm256_add_epi64(t[limbs], c);
+            t[limbs - 1] = _mm256_and_si256(s, mask);
+            t[limbs] = _mm256_add_epi64(t[limbs + 1], _mm256_srli_epi64(s, 32));
+        }
+        // t - m in every lane, it's kept where it didn't borrow out of t[limbs]
+        __m256i d[n];
+        __m256i borrow = _mm256_setzero_si256();
+        for (unsigned int j = 0; j < limbs; ++j)
+        {
+            s = _mm256_sub_epi64(_mm256_sub_epi64(t[j], _mm256_set1_epi64x(m[j])), borrow);
+            d[j] = _mm256_and_si256(s, mask);
+            borrow = _mm256_srli_epi64(s, 63);
+        }
+        __m256i keep_t = _mm256_cmpgt_epi64(borrow, t[limbs]);
+        const __m256i pack = _mm256_setr_epi32(0, 2, 4, 6, 0, 0, 0, 0);
+        for (unsigned int j = 0; j < limbs; ++j)
+        {
+            __m256i x = _mm256_permutevar8x32_epi32(_mm256_blendv_epi8(d[j], t[j], keep_t), pack);
+            _mm_storeu_si128((__m128i *)(r + j * stride), _mm256_castsi256_si128(x));
+        }
+        for (unsigned int j = limbs; j < n; ++j)
+            _mm_storeu_si128((__m128i *)(r + j * stride), _mm_setzero_si128());
+    }
+
+    /**
+     * Lane-parallel CIOS Montgomery multiplication for 8 lanes with AVX-512F, every limb is in a 64 bit lane.
+     * @param r, a, b limb i of lane l is at [i * stride + l], r may be the same as a or b
+     * @param limbs number of limbs of the modulus
+     */
+    template <unsigned int n>
+    __attribute__((target("avx512f"))) void multiply_lanes_avx512(unsigned int *r, const unsigned int *a, const unsigned int *b, const unsigned int &stride,
+                                                                  const unsigned int *m, const unsigned int &m_prime, const unsigned int &limbs)
+    {
+        // the zero-masked forms with every lane selected: the plain ones pass an undefined vector
+        // to the builtins, and GCC 12 warns about it with -Wmaybe-uninitialized
+        const __mmask8 all = 0xFF;
+        const __m512i mask = _mm512_set1_epi64(0xFFFFFFFFULL);
+        const __m512i vm_prime = _mm512_set1_epi64(m_prime);
+        __m512i va[n];
+        __m512i t[n + 2];
+        __m512i c;
+        __m512i s;
+        for (unsigned int j = 0; j < limbs; ++j)
+            va[j] = _mm512_maskz_cvtepu32_epi64(all, _mm256_loadu_si256((const __m256i *)(a + j * stride)));
+        for (unsigned int j = 0; j < limbs + 2; ++j)
+            t[j] = _mm512_setzero_si512();
+        for (unsigned int i = 0; i < limbs; ++i)
+        {
+            __m512i vb = _mm512_maskz_cvtepu32_epi64(all, _mm256_loadu_si256((const __m256i *)(b + i * stride)));
+            c = _mm512_setzero_si512();
+            for (unsigned int j = 0; j < limbs; ++j)
+            {
+                s = _mm512_add_epi64(_mm512_add_epi64(t[j], _mm512_maskz_mul_epu32(all, va[j], vb)), c);
+                t[j] = _mm512_and_si512(s, mask);
+                c = _mm512_maskz_srli_epi64(all, s, 32);
+            }
+            s = _mm512_add_epi64(t[limbs], c);
+            t[limbs] = _mm512_and_si512(s, mask);
+            t[limbs + 1] = _mm512_maskz_srli_epi64(all, s, 32);
+            __m512i q = _mm512_and_si512(_mm512_maskz_mul_epu32(all, t[0], vm_prime), mask);
+            c = _mm512_maskz_srli_epi64(all, _mm512_add_epi64(t[0], _mm512_maskz_mul_epu32(all, q, _mm512_set1_epi64(m[0]))), 32);
+            for (unsigned int j = 1; j < limbs; ++j)
+            {
+                s = _mm512_add_epi64(_mm512_add_epi64(t[j], _mm512_maskz_mul_epu32(all, q, _mm512_set1_epi64(m[j]))), c);
+                t[j - 1] = _mm512_and_si512(s, mask);
+                c = _mm512_maskz_srli_epi64(all, s, 32);
+            }
+            s = _mm512_add_epi64(t[limbs], c);
+            t[limbs - 1] = _mm512_and_si512(s, mask);
+            t[limbs] = _mm512_add_epi64(t[limbs + 1], _mm512_maskz_srli_epi64(all, s, 32));
+        }
+        __m512i d[n];
+        __m512i borrow = _mm512_setzero_si512();
+        for (unsigned int j = 0; j < limbs; ++j)
+        {
+            s = _mm512_sub_epi64(_mm512_sub_epi64(t[j], _mm512_set1_epi64(m[j])), borrow);
+            d[j] = _mm512_and_si512(s, mask);
+            borrow = _mm512_maskz_srli_epi64(all, s, 63);
+        }
+        __mmask8 keep_t = _mm512_cmplt_epu64_mask(t[limbs], borrow);
+        for (unsigned int j = 0; j < limbs; ++j)
+            _mm256_storeu_si256((__m256i *)(r + j * stride), _mm512_maskz_cvtepi64_epi32(all, _mm512_mask_blend_epi64(keep_t, d[j], t[j])));
+        for (unsigned int j = limbs; j < n; ++j)
+            _mm256_storeu_si256((__m256i *)(r + j * stride), _mm256_setzero_si256());
+    }
+#endif
+}
+
+/**
+ * Montgomery arithmetic on every lane of a BigintBatch at once, modulo a shared odd modulus.
+ * All lanes go through the same steps, so an exponentiation with one exponent for the whole batch
+ * keeps the lanes in lockstep. The lanes use radix 2^32, the products of 8 lanes are computed by one
+ * AVX-512 instruction, or 4 lanes by one AVX2 instruction.
+ * @tparam bits number of bits used to store the integers, the modulus has to fit into bits - 1.
+ * @tparam Lanes number of numbers in a batch
+ */
+template <unsigned int bits, unsigned int Lanes>
+struct MontgomeryBatch
+{
+    // the scalar context, its R is 2^(32 * limbs) like the lane kernels'
+    MontgomeryContext<bits> context;
+    // scalar_kernels, avx2_kernels or avx512ifma_kernels (the lane kernel only needs AVX-512F from it)
+    kernel_set kernels;
+    MontgomeryBatch(const Bigint<bits> &);
+    MontgomeryBatch(const Bigint<bits> &, const kernel_set &);
+    // Montgomery product of every lane: a * b * R^(-1) mod modulus, res may be the same as a or b
+    void multiply(BigintBatch<bits, Lanes> &, const BigintBatch<bits, Lanes> &, const BigintBatch<bits, Lanes> &) const;
+    BigintBatch<bits, Lanes> to_montgomery(const BigintBatch<bits, Lanes> &) const;
+    BigintBatch<bits, Lanes> from_montgomery(const BigintBatch<bits, Lanes> &) const;
+    // modular exponentiation of every lane with the same exponent
+    BigintBatch<bits, Lanes> exponentiation(const BigintBatch<bits, Lanes> &, const Bigint<bits> &) const;
+    // modular exponentiation of every lane with a constant exponent
+    template <unsigned long long exponent>
+    BigintBatch<bits, Lanes> exponentiation(const BigintBatch<bits, Lanes> &) const;
+
+private:
+    static constexpr unsigned int n = bits / (sizeof(unsigned int) * 8);
+    BigintBatch<bits, Lanes> broadcast(const Bigint<bits> &) const;
+    BigintBatch<bits, Lanes> reduce(const BigintBatch<bits, Lanes> &) const;
+};
+
+/**
+ * @param m the modulus, it has to be odd.
+ */
+template <unsigned int bits, unsigned int Lanes>
+MontgomeryBatch<bits, Lanes>::MontgomeryBatch(const Bigint<bits> &m)
+    : MontgomeryBatch(m, montgomery_kernels::supported_avx512f() ? avx512ifma_kernels : avx2_kernels)
+{
+}
+
+/**
+ * @param m the modulus, it has to be odd.
+ * @param k the lane kernel, the scalar one is used if the CPU doesn't support it or Lanes isn't a multiple of its width
+ */
+template <unsigned int bits, unsigned int Lanes>
+MontgomeryBatch<bits, Lanes>::MontgomeryBatch(const Bigint<bits> &m, const kernel_set &k) : context(m, scalar_kernels), kernels(k)
+{
+    bool supported = kernels == avx512ifma_kernels ? montgomery_kernels::supported_avx512f() : montgomery_kernels::supported(kernels);
+    if (kernels == adx_kernels || !supported ||
+        (kernels == avx512ifma_kernels && Lanes % 8 != 0) || (kernels == avx2_kernels && Lanes % 4 != 0))
+        kernels = scalar_kernels;
+}
+
+template <unsigned int bits, unsigned int Lanes>
+void MontgomeryBatch<bits, Lanes>::multiply(BigintBatch<bits, Lanes> &res, const BigintBatch<bits, Lanes> &a, const BigintBatch<bits, Lanes> &b) const
+{
+    const unsigned int *m = context.modulus.storage;
+#ifdef MONTGOMERY_X86_KERNELS
+    if (kernels == avx512ifma_kernels)
+    {
+        for (unsigned int l = 0; l < Lanes; l += 8)
+            montgomery_kernels::multiply_lanes_avx512<n>(&res.storage[0][l], &a.storage[0][l], &b.storage[0][l], Lanes, m, context.m_prime, context.limbs);
+        return;
+    }
+    if (kernels == avx2_kernels)
+    {
+        for (unsigned int l = 0; l < Lanes; l += 4)
+            montgomery_kernels::multiply_lanes_avx2<n>(&res.storage[0][l], &a.storage[0][l], &b.storage[0][l], Lanes, m, context.m_prime, context.limbs);
+        return;
+    }
+#endif
+    montgomery_kernels::multiply_lanes_scalar<n, Lanes>(&res.storage[0][0], &a.storage[0][0], &b.storage[0][0], Lanes, m, context.m_prime, context.limbs);
+}
+
+/**
+ * @return a batch with x in every lane
+ */
+template <unsigned int bits, unsigned int Lanes>
+BigintBatch<bits, Lanes> MontgomeryBatch<bits, Lanes>::broadcast(const Bigint<bits> &x) const
+{
+    BigintBatch<bits, Lanes> res;
+    for (unsigned int i = 0; i < n; ++i)
+        for (unsigned int l = 0; l < Lanes; ++l)
+            res.storage[i][l] = x.storage[i];
+    return res;
+}
+
+/**
+ * @return x with the lanes that are not less than the modulus reduced
+ */
+template <unsigned int bits, unsigned int Lanes>
+BigintBatch<bits, Lanes> MontgomeryBatch<bits, Lanes>::reduce(const BigintBatch<bits, Lanes> &x) const
+{
+    BigintBatch<bits, Lanes> res(x);
+    for (unsigned int l = 0; l < Lanes; ++l)
+    {
+        int i = n - 1;
+        while (i > 0 && x.storage[i][l] == context.modulus.storage[i])
+            --i;
+        if (x.storage[i][l] >= context.modulus.storage[i])
+            res.set(l, x.get(l) % context.modulus);
+    }
+    return res;
+}
+
+template <unsigned int bits, unsigned int Lanes>
+BigintBatch<bits, Lanes> MontgomeryBatch<bits, Lanes>::to_montgomery(const BigintBatch<bits, Lanes> &x) const
+{
+    BigintBatch<bits, Lanes> res;
+    multiply(res, x, broadcast(context.r2));
+    return res;
+}
+
+template <unsigned int bits, unsigned int Lanes>
+BigintBatch<bits, Lanes> MontgomeryBatch<bits, Lanes>::from_montgomery(const BigintBatch<bits, Lanes> &x) const
+{
+    BigintBatch<bits, Lanes> res;
+    multiply(res, x, broadcast(Bigint<bits>(1)));
+    return res;
+}
+
+/**
+ * Left-to-right square and multiply exponentiation, the same steps for every lane.
+ * @param a the bases, the lanes that are not less than the modulus are reduced first
+ * @param b the exponent of every lane
+ * @return aˆb % modulus in every lane
+ */
+template <unsigned int bits, unsigned int Lanes>
+BigintBatch<bits, Lanes> MontgomeryBatch<bits, Lanes>::exponentiation(const BigintBatch<bits, Lanes> &a, const Bigint<bits> &b) const
+{
+    BigintBatch<bits, Lanes> base = to_montgomery(reduce(a));
+    BigintBatch<bits, Lanes> c = broadcast(context.r);
+    for (int i = b.num_bits() - 1; i >= 0; --i)
+    {
+        multiply(c, c, c);
+        if ((b.storage[i / (sizeof(unsigned int) * 8)] >> (i % (sizeof(unsigned int) * 8))) & 1)
+            multiply(c, c, base);
+    }
+    return from_montgomery(c);
+}
+
+/**
+ * Exponentiation with the addition chain of a constant exponent, the same steps for every lane.
+ * @tparam exponent has to be greater than 0
+ * @param a the bases, the lanes that are not less than the modulus are reduced first
+ * @return aˆexponent % modulus in every lane
+ */
+template <unsigned int bits, unsigned int Lanes>
+template <unsigned long long exponent>
+BigintBatch<bits, Lanes> MontgomeryBatch<bits, Lanes>::exponentiation(const BigintBatch<bits, Lanes> &a) const
+{
+    BigintBatch<bits, Lanes> base = to_montgomery(reduce(a));
+    BigintBatch<bits, Lanes> c(base);
+    for (unsigned int i = 0; i < AdditionChain<exponent>::length; ++i)
+    {
+        multiply(c, c, c);
+        if (AdditionChain<exponent>::steps.multiply[i])
+            multiply(c, c, base);
+    }
+    return from_montgomery(c);
+}
+
+#endif
@@ -0,0 +1,219 @@
+#ifndef BIGINT_CONSTANT_H
+#define BIGINT_CONSTANT_H
+
+#include <stdexcept>
+#include "mpn.h"
+
+/**
+ * A fixed-width unsigned integer that can be used in constant expressions.
+ * Bigint keeps its limbs on the heap, so it can't be constexpr; this type stores the same little-endian
+ * limbs inline and implements the operations needed for constants: construction, hexadecimal parsing,
+ * addition, subtraction, truncated multiplication, shifts and comparisons.
+ * A Bigint can be constructed from it and compared with it without allocating a temporary.
+ * @tparam bits number of bits used for storage, at least 64.
+ * If bits % 32 != 0: it will be rounded downwards to the nearest multiple of 32.
+ */
+template <unsigned int bits = 64>
+struct BigintConstant
+{
+    static_assert(bits >= 64, "a BigintConstant stores at least 64 bits");
+    static constexpr unsigned int n = bits / (sizeof(unsigned int) * 8);
+    // stores the number in a little-endian order
+    unsigned int storage[n];
+    constexpr BigintConstant(const unsigned long long &x = 0) : storage{(unsigned int)x, (unsigned int)(x >> (sizeof(unsigned int) * 8))} {}
+    // hexadecimal string, like the Bigint constructor
+    constexpr BigintConstant(const char *const &);
+    // zero-extends or truncates a constant of another width
+    template <unsigned int other>
+    constexpr BigintConstant(const BigintConstant<other> &);
+    // parses the digits of a number in the given base, the ' separators are skipped
+    static constexpr BigintConstant parse(const char *, const unsigned int &);
+    constexpr bool operator==(const BigintConstant &x) const { return mpn::cmp(storage, x.storage, n) == 0; }
+    constexpr bool operator!=(const BigintConstant &x) const { return mpn::cmp(storage, x.storage, n) != 0; }
+    constexpr bool operator<(const BigintConstant &x) const { return mpn::cmp(storage, x.storage, n) < 0; }
+    constexpr bool operator>(const BigintConstant &x) const { return mpn::cmp(storage, x.storage, n) > 0; }
+    constexpr unsigned int num_bits() const;
+    constexpr BigintConstant operator+(const BigintConstant &) const;
+    constexpr BigintConstant operator-(const BigintConstant &) const;
+    constexpr BigintConstant operator*(const BigintConstant &) const;
+    constexpr BigintConstant operator<<(const unsigned int &) const;
+    constexpr BigintConstant operator>>(const unsigned int &) const;
+
+private:
+    static constexpr unsigned int digit_value(const char &);
+};
+
+/**
+ * @return the value of a digit in any base up to 16, or 16 if it's not a digit
+ */
+template <unsigned int bits>
+constexpr unsigned int BigintConstant<bits>::digit_value(const char &c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return 16;
+}
+
+/**
+ * Every digit multiplies the number by the base and adds the digit, the digits above bits are dropped.
+ * @param x C string with a '\0' null terminator
+ * @param base 2, 8, 10 or 16
+ */
+template <unsigned int bits>
+constexpr BigintConstant<bits> BigintConstant<bits>::parse(const char *x, const unsigned int &base)
+{
+    BigintConstant res;
+    for (; *x != '\0'; ++x)
+    {
+        if (*x == '\'')
+            continue;
+        unsigned int digit = digit_value(*x);
+        if (digit >= base)
+            throw std::domain_error("found an invalid digit in the constant");
+        mpn::mul_1(res.storage, res.storage, n, base);
+        const unsigned int add[n] = {digit};
+        mpn::add_n(res.storage, res.storage, add, n);
+    }
+    return res;
+}
+
+/**
+ * @param x C string with a '\0' null terminator.
+ * It may only consist a hexadecimal number (letter capitalization doesn't matter).
+ */
+template <unsigned int bits>
+constexpr BigintConstant<bits>::BigintConstant(const char *const &x) : storage{}
+{
+    BigintConstant res = parse(x, 16);
+    for (unsigned int i = 0; i < n; ++i)
+        storage[i] = res.storage[i];
+}
+
+template <unsigned int bits>
+template <unsigned int other>
+constexpr BigintConstant<bits>::BigintConstant(const BigintConstant<other> &x) : storage{}
+{
+    for (unsigned int i = 0; i < n && i < BigintConstant<other>::n; ++i)
+        storage[i] = x.storage[i];
+}
+
+template <unsigned int bits>
+constexpr unsigned int BigintConstant<bits>::num_bits() const
+{
+    unsigned int i = mpn::size(storage, n);
+    if (i == 0)
+        return 0;
+    unsigned int top = storage[i - 1];
+    unsigned int res = (i - 1) * sizeof(unsigned int) * 8;
+    while (top != 0)
+    {
+        ++res;
+        top >>= 1;
+    }
+    return res;
+}
+
+template <unsigned int bits>
+constexpr BigintConstant<bits> BigintConstant<bits>::operator+(const BigintConstant &x) const
+{
+    BigintConstant res;
+    mpn::add_n(res.storage, storage, x.storage, n);
+    return res;
+}
+
+template <unsigned int bits>
+constexpr BigintConstant<bits> BigintConstant<bits>::operator-(const BigintConstant &x) const
+{
+    BigintConstant res;
+    mpn::sub_n(res.storage, storage, x.storage, n);
+    return res;
+}
+
+/**
+ * @return the product truncated to bits, like Bigint::operator*
+ */
+template <unsigned int bits>
+constexpr BigintConstant<bits> BigintConstant<bits>::operator*(const BigintConstant &x) const
+{
+    BigintConstant res;
+    mpn::mul_low(res.storage, storage, x.storage, n);
+    return res;
+}
+
+template <unsigned int bits>
+constexpr BigintConstant<bits> BigintConstant<bits>::operator<<(const unsigned int &shift) const
+{
+    BigintConstant res;
+    if (shift >= bits)
+        return res;
+    unsigned int full_shifts = shift / (sizeof(unsigned int) * 8);
+    unsigned int bit_shift = shift % (sizeof(unsigned int) * 8);
+    for (unsigned int i = n; i > full_shifts; --i)
+    {
+        unsigned int j = i - 1 - full_shifts;
+        res.storage[i - 1] = storage[j] << bit_shift;
+        if (bit_shift != 0 && j > 0)
+            res.storage[i - 1] |= storage[j - 1] >> (sizeof(unsigned int) * 8 - bit_shift);
+    }
+    return res;
+}
+
+template <unsigned int bits>
+constexpr BigintConstant<bits> BigintConstant<bits>::operator>>(const unsigned int &shift) const
+{
+    BigintConstant res;
+    if (shift >= bits)
+        return res;
+    unsigned int full_shifts = shift / (sizeof(unsigned int) * 8);
+    unsigned int bit_shift = shift % (sizeof(unsigned int) * 8);
+    for (unsigned int i = 0; i + full_shifts < n; ++i)
+    {
+        unsigned int j = i + full_shifts;
+        res.storage[i] = storage[j] >> bit_shift;
+        if (bit_shift != 0 && j + 1 < n)
+            res.storage[i] |= storage[j + 1] << (sizeof(unsigned int) * 8 - bit_shift);
+    }
+    return res;
+}
+
+/**
+ * The width of a _big literal: 4 bits per digit is enough in every base up to 16,
+ * rounded up to whole array elements and at least 64 bits.
+ */
+template <char... digits>
+constexpr unsigned int literal_bits()
+{
+    constexpr char text[] = {digits..., '\0'};
+    // the 0x and 0b prefixes are not digits
+    unsigned int start = text[0] == '0' && (text[1] == 'x' || text[1] == 'X' || text[1] == 'b' || text[1] == 'B') ? 2 : 0;
+    unsigned int count = 0;
+    for (unsigned int i = start; text[i] != '\0'; ++i)
+        if (text[i] != '\'')
+            ++count;
+    unsigned int res = (4 * count + sizeof(unsigned int) * 8 - 1) / (sizeof(unsigned int) * 8) * (sizeof(unsigned int) * 8);
+    return res < 64 ? 64 : res;
+}
+
+/**
+ * Compile-time Bigint constant, e.g. 0x10001_big or 65537_big.
+ * The prefixes of the integer literals select the base: 0x hexadecimal, 0b binary, 0 octal, otherwise decimal.
+ * @return a BigintConstant just wide enough for the literal, it converts to any wider Bigint or BigintConstant
+ */
+template <char... digits>
+constexpr BigintConstant<literal_bits<digits...>()> operator""_big()
+{
+    constexpr char text[] = {digits..., '\0'};
+    if (text[0] == '0' && (text[1] == 'x' || text[1] == 'X'))
+        return BigintConstant<literal_bits<digits...>()>::parse(text + 2, 16);
+    if (text[0] == '0' && (text[1] == 'b' || text[1] == 'B'))
+        return BigintConstant<literal_bits<digits...>()>::parse(text + 2, 2);
+    if (text[0] == '0')
+        return BigintConstant<literal_bits<digits...>()>::parse(text, 8);
+    return BigintConstant<literal_bits<digits...>()>::parse(text, 10);
+}
+
+#endif
@@ -0,0 +1,110 @@
+#ifndef BIGINT_EXPR_H
+#define BIGINT_EXPR_H
+
+#include <iostream>
+#include <stdexcept>
+#include <utility>
+#include "bigint.h"
+#include "mpn.h"
+#include "scratch_arena.h"
+#include "memtrace.h"
+
+/**
+ * The unevaluated result of Bigint::operator*, it only refers to the operands.
+ * Converting it to a Bigint computes the truncated product like before, while (a * b) % m,
+ * (a * b) / d and a + b * c are fused: the product is kept in scratch limbs or accumulated into
+ * the result, so the only Bigint allocated is the result itself.
+ * The fused operators give the same result as the evaluated product would, it's truncated to bits too.
+ * It refers to the operands, so it can't outlive the full expression. Every member is rvalue-qualified:
+ * a product stored with auto can't be evaluated without an explicit std::move.
+ * @tparam bits number of bits used to store the integers.
+ * @tparam Allocator the allocator of the operands and the result
+ */
+template <unsigned int bits, typename Allocator>
+struct BigintProduct
+{
+    const Bigint<bits, Allocator> &a;
+    const Bigint<bits, Allocator> &b;
+    BigintProduct(const Bigint<bits, Allocator> &x, const Bigint<bits, Allocator> &y) : a(x), b(y) {}
+    // evaluates the product
+    operator Bigint<bits, Allocator>() const &&;
+    // multiply-reduce: a * b % x
+    Bigint<bits, Allocator> operator%(const Bigint<bits, Allocator> &) const &&;
+    // multiply-divide: a * b / x, e.g. the lcm as a * b / gcd(a, b)
+    Bigint<bits, Allocator> operator/(const Bigint<bits, Allocator> &) const &&;
+    // multiply-accumulate: a * b + x
+    Bigint<bits, Allocator> operator+(const Bigint<bits, Allocator> &x) const && { return x + std::move(*this); }
+
+private:
+    static constexpr unsigned int n = bits / (sizeof(unsigned int) * 8);
+};
+
+template <unsigned int bits, typename Allocator>
+BigintProduct<bits, Allocator>::operator Bigint<bits, Allocator>() const &&
+{
+    BIGINT_COUNT(op_multiplication, bits);
+    Bigint<bits, Allocator> res;
+    mpn::mul_low(res.storage, a.storage, b.storage, n);
+    return res;
+}
+
+/**
+ * @param x the divisor, it can't be 0
+ */
+template <unsigned int bits, typename Allocator>
+Bigint<bits, Allocator> BigintProduct<bits, Allocator>::operator%(const Bigint<bits, Allocator> &x) const &&
+{
+    BIGINT_COUNT(op_multiplication, bits);
+    BIGINT_COUNT(op_modulo, bits);
+    unsigned int dn = mpn::size(x.storage, n);
+    if (dn == 0)
+        throw std::domain_error("division by zero");
+    ScratchArray<n> product_limbs(n);
+    unsigned int *product = product_limbs.limbs();
+    mpn::mul_low(product, a.storage, b.storage, n);
+    unsigned int nn = mpn::size(product, n);
+    Bigint<bits, Allocator> rem;
+    if (nn < dn)
+    {
+        std::memcpy(rem.storage, product, nn * sizeof(unsigned int));
+        return rem;
+    }
+    ScratchArray<2 * n + 1> scratch(nn + dn + 1);
+    mpn::divrem(nullptr, rem.storage, product, nn, x.storage, dn, scratch.limbs());
+    return rem;
+}
+
+/**
+ * @param x the divisor, it can't be 0
+ * @return the quotient rounded downwards
+ */
+template <unsigned int bits, typename Allocator>
+Bigint<bits, Allocator> BigintProduct<bits, Allocator>::operator/(const Bigint<bits, Allocator> &x) const &&
+{
+    BIGINT_COUNT(op_multiplication, bits);
+    BIGINT_COUNT(op_division, bits);
+    unsigned int dn = mpn::size(x.storage, n);
+    if (dn == 0)
+        throw std::domain_error("division by zero");
+    ScratchArray<n> product_limbs(n);
+    unsigned int *product = product_limbs.limbs();
+    mpn::mul_low(product, a.storage, b.storage, n);
+    unsigned int nn = mpn::size(product, n);
+    Bigint<bits, Allocator> quo;
+    if (nn < dn)
+        return quo;
+    ScratchArray<2 * n + 1> scratch(nn + dn + 1);
+    mpn::divrem(quo.storage, nullptr, product, nn, x.storage, dn, scratch.limbs());
+    return quo;
+}
+
+/**
+ * Prints the evaluated product, e.g. std::cout << a * b.
+ */
+template <unsigned int bits, typename Allocator>
+std::ostream &operator<<(std::ostream &os, BigintProduct<bits, Allocator> &&x)
+{
+    return os << Bigint<bits, Allocator>(std::move(x));
+}
+
+#endif
@@ -0,0 +1,214 @@
+#ifndef BIGINT_POOL_H
+#define BIGINT_POOL_H
+
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <vector>
+#include "memtrace.h"
+
+/**
+ * The storage of a Bigint comes from its Allocator template parameter, it has two static functions:
+ * allocate<limbs>() returns an uninitialized array of limbs, deallocate<limbs>(p) frees it.
+ * The array can be freed on any thread, not only on the one that allocated it.
+ */
+
+/**
+ * Every limb array is a new[] of the general-purpose heap, memtrace sees each of them.
+ */
+struct BigintHeapAllocator
+{
+    template <unsigned int limbs>
+    static unsigned int *allocate() { return new unsigned int[limbs]; }
+    template <unsigned int limbs>
+    static void deallocate(unsigned int *p) { delete[] p; }
+};
+
+/**
+ * Free list of the limb arrays of one width. Every thread owns a pool, allocation pops its local list
+ * and a free on the owner thread pushes it back. Every block starts with a pointer to its pool, so a block
+ * freed on another thread is pushed onto the remote list of the owner with a compare-and-swap, the owner
+ * takes the whole remote list at once when its local list is empty.
+ * When a thread exits its pools are abandoned, not freed, as their blocks may still be alive; the next
+ * thread that needs a pool of that width adopts one. The chunks are freed when the program exits.
+ * @tparam limbs the number of limbs of an array, e.g. bits / 32 of a Bigint
+ */
+template <unsigned int limbs>
+class LimbPool
+{
+    struct Block
+    {
+        LimbPool *owner;
+        // the next free block while the block is on a free list
+        Block *next;
+    };
+    // the header is rounded up to keep the limbs 16 byte aligned
+    static const size_t header = (sizeof(LimbPool *) + 15) / 16 * 16;
+    static const size_t block_size = (header + limbs * sizeof(unsigned int) + 15) / 16 * 16;
+    // the blocks are carved from chunks of about 64 KB, or 16 blocks if they are bigger
+    static const size_t chunk_blocks = 64 * 1024 / block_size > 16 ? 64 * 1024 / block_size : 16;
+
+    Block *local_free = nullptr;
+    std::atomic<Block *> remote_free;
+    std::vector<char *> chunks;
+
+    /**
+     * Every pool of this width, the abandoned ones can be adopted by a new thread.
+     * It's a function-local static, so it's created before the first block and destroyed after the last static Bigint.
+     */
+    struct Registry
+    {
+        std::mutex lock;
+        std::vector<LimbPool *> pools;
+        std::vector<LimbPool *> abandoned;
+        ~Registry()
+        {
+            for (size_t i = 0; i < pools.size(); ++i)
+                delete pools[i];
+        }
+    };
+    static Registry &registry()
+    {
+        static Registry r;
+        return r;
+    }
+
+    // the pool of a thread, it's abandoned when the thread exits
+    struct ThreadOwner
+    {
+        LimbPool *pool = nullptr;
+        ~ThreadOwner()
+        {
+            if (pool == nullptr)
+                return;
+            Registry &r = registry();
+            std::lock_guard<std::mutex> guard(r.lock);
+            r.abandoned.push_back(pool);
+        }
+    };
+
+    static ThreadOwner &thread()
+    {
+        static thread_local ThreadOwner owner;
+        return owner;
+    }
+
+    // the pool of the calling thread, a new or an abandoned one is taken at the first allocation
+    static LimbPool *local()
+    {
+        ThreadOwner &thread = LimbPool::thread();
+        if (thread.pool == nullptr)
+        {
+            Registry &r = registry();
+            std::lock_guard<std::mutex> guard(r.lock);
+            if (!r.abandoned.empty())
+            {
+                thread.pool = r.abandoned.back();
+                r.abandoned.pop_back();
+            }
+            else
+            {
+                thread.pool = new LimbPool;
+                r.pools.push_back(thread.pool);
+            }
+        }
+        return thread.pool;
+    }
+
+    static Block *block(unsigned int *p) { return (Block *)((char *)p - header); }
+    static unsigned int *limbs_of(Block *b) { return (unsigned int *)((char *)b + header); }
+
+    LimbPool() : remote_free(nullptr) {}
+    ~LimbPool()
+    {
+        for (size_t i = 0; i < chunks.size(); ++i)
+            delete[] chunks[i];
+    }
+
+    Block *pop()
+    {
+        if (local_free == nullptr)
+            local_free = remote_free.exchange(nullptr, std::memory_order_acquire);
+        if (local_free == nullptr)
+            grow();
+        Block *b = local_free;
+        local_free = b->next;
+        return b;
+    }
+
+    void grow()
+    {
+        char *chunk = new char[chunk_blocks * block_size];
+        {
+            // chunk_count() may read the list on another thread
+            std::lock_guard<std::mutex> guard(registry().lock);
+            chunks.push_back(chunk);
+        }
+        for (size_t i = chunk_blocks; i > 0; --i)
+        {
+            Block *b = (Block *)(chunk + (i - 1) * block_size);
+            b->owner = this;
+            b->next = local_free;
+            local_free = b;
+        }
+    }
+
+    void push_remote(Block *b)
+    {
+        Block *head = remote_free.load(std::memory_order_relaxed);
+        do
+            b->next = head;
+        while (!remote_free.compare_exchange_weak(head, b, std::memory_order_release, std::memory_order_relaxed));
+    }
+
+public:
+    static unsigned int *allocate() { return limbs_of(local()->pop()); }
+
+    static void deallocate(unsigned int *p)
+    {
+        Block *b = block(p);
+        // a thread that never allocated has no pool, every block is remote for it
+        LimbPool *pool = thread().pool;
+        if (b->owner == pool)
+        {
+            b->next = pool->local_free;
+            pool->local_free = b;
+        }
+        else
+            b->owner->push_remote(b);
+    }
+
+    // the number of chunks allocated by every pool of this width
+    static size_t chunk_count()
+    {
+        Registry &r = registry();
+        std::lock_guard<std::mutex> guard(r.lock);
+        size_t res = 0;
+        for (size_t i = 0; i < r.pools.size(); ++i)
+            res += r.pools[i]->chunks.size();
+        return res;
+    }
+};
+
+/**
+ * The limb arrays come from the LimbPool of their width, an allocation is a pop of a thread-local free list.
+ */
+struct BigintPoolAllocator
+{
+    template <unsigned int limbs>
+    static unsigned int *allocate() { return LimbPool<limbs>::allocate(); }
+    template <unsigned int limbs>
+    static void deallocate(unsigned int *p) { LimbPool<limbs>::deallocate(p); }
+};
+
+/**
+ * The allocator of Bigint if it isn't given. With MEMTRACE every limb array has to be a heap block,
+ * so memtrace can find the leaked ones; otherwise the pool is used. make test-pool runs the tests that way.
+ */
+#ifdef MEMTRACE
+typedef BigintHeapAllocator BigintDefaultAllocator;
+#else
+typedef BigintPoolAllocator BigintDefaultAllocator;
+#endif
+
+#endif
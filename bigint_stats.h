@@ -0,0 +1,156 @@
+#ifndef BIGINT_STATS_H
+#define BIGINT_STATS_H
+
+/**
+ * Operation counters of Bigint and MontgomeryContext.
+ * If BIGINT_STATS is defined, every operation increments a thread-local counter
+ * selected by the operation and the size class of the operands.
+ * Otherwise the counting macros are empty and the snapshots are always zero.
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <type_traits>
+#include "memtrace.h"
+
+//#define BIGINT_STATS
+
+enum bigint_operation
+{
+    op_addition,
+    op_subtraction,
+    op_multiplication,
+    op_division,
+    op_modulo,
+    op_shift_left,
+    op_shift_right,
+    op_gcd,
+    op_exponentiation,
+    op_inverse,
+    op_prime_check,
+    op_montgomery_multiply,
+    op_barrett_reduce,
+    // the subtractions at the end of a Barrett reduction, at most 2 per reduction
+    op_barrett_correction,
+    op_allocation,
+    op_deallocation,
+    operation_count
+};
+
+enum stats_size
+{
+    // size classes of 1, 2, 4, ... 512 limbs, larger numbers are in the last class
+    size_class_count = 10
+};
+
+/**
+ * A set of counters, the counts of one thread can be taken with snapshot(),
+ * the difference of two snapshots is the work done in between.
+ */
+struct BigintStats
+{
+    unsigned long long counts[operation_count][size_class_count];
+    // total size of the allocated storage
+    unsigned long long allocated_bytes;
+    constexpr BigintStats() : counts{}, allocated_bytes(0) {}
+    // returns the count of the operation summed over every size class
+    unsigned long long total(const bigint_operation &) const;
+    // returns the count of the operation on Bigint<bits> operands
+    unsigned long long count(const bigint_operation &, const unsigned int &) const;
+    BigintStats operator-(const BigintStats &) const;
+    // the counters of the calling thread
+    static BigintStats snapshot();
+    static void reset();
+    static const char *name(const bigint_operation &);
+    /**
+     * @param bits the template parameter of Bigint
+     * @return the index of the smallest power of 2 number of limbs that holds bits
+     */
+    static constexpr unsigned int size_class(const unsigned int &bits)
+    {
+        unsigned int c = 0;
+        while (c + 1 < size_class_count && (1U << c) * sizeof(unsigned int) * 8 < bits)
+            ++c;
+        return c;
+    }
+};
+
+#ifdef BIGINT_STATS
+inline thread_local BigintStats bigint_thread_stats;
+// the size class is a compile time constant, so a count is a single increment
+#define BIGINT_COUNT(operation, bits) \
+    (++bigint_thread_stats.counts[operation][std::integral_constant<unsigned int, BigintStats::size_class(bits)>::value])
+#define BIGINT_COUNT_ALLOCATION(bits) \
+    (BIGINT_COUNT(op_allocation, bits), bigint_thread_stats.allocated_bytes += (bits) / 8)
+#else
+#define BIGINT_COUNT(operation, bits) ((void)0)
+#define BIGINT_COUNT_ALLOCATION(bits) ((void)0)
+#endif
+
+inline unsigned long long BigintStats::total(const bigint_operation &op) const
+{
+    unsigned long long sum = 0;
+    for (unsigned int c = 0; c < size_class_count; ++c)
+        sum += counts[op][c];
+    return sum;
+}
+
+inline unsigned long long BigintStats::count(const bigint_operation &op, const unsigned int &bits) const
+{
+    return counts[op][size_class(bits)];
+}
+
+inline BigintStats BigintStats::operator-(const BigintStats &x) const
+{
+    BigintStats res;
+    for (unsigned int op = 0; op < operation_count; ++op)
+        for (unsigned int c = 0; c < size_class_count; ++c)
+            res.counts[op][c] = counts[op][c] - x.counts[op][c];
+    res.allocated_bytes = allocated_bytes - x.allocated_bytes;
+    return res;
+}
+
+inline BigintStats BigintStats::snapshot()
+{
+#ifdef BIGINT_STATS
+    return bigint_thread_stats;
+#else
+    return BigintStats();
+#endif
+}
+
+inline void BigintStats::reset()
+{
+#ifdef BIGINT_STATS
+    bigint_thread_stats = BigintStats();
+#endif
+}
+
+inline const char *BigintStats::name(const bigint_operation &op)
+{
+    static const char *const names[operation_count] = {
+        "addition", "subtraction", "multiplication", "division", "modulo", "shift_left", "shift_right",
+        "gcd", "exponentiation", "inverse", "prime_check", "montgomery_multiply", "barrett_reduce", "barrett_correction", "allocation", "deallocation"};
+    return names[op];
+}
+
+/**
+ * Prints the nonzero counters, one operation per line with the counts of every size class.
+ */
+inline std::ostream &operator<<(std::ostream &os, const BigintStats &x)
+{
+    for (unsigned int op = 0; op < operation_count; ++op)
+    {
+        if (x.total((bigint_operation)op) == 0)
+            continue;
+        os << std::left << std::setw(20) << BigintStats::name((bigint_operation)op) << std::right << std::setw(12) << x.total((bigint_operation)op);
+        for (unsigned int c = 0; c < size_class_count; ++c)
+            if (x.counts[op][c] != 0)
+                os << "  " << (1U << c) * sizeof(unsigned int) * 8 << "b:" << x.counts[op][c];
+        os << std::endl;
+    }
+    os << std::left << std::setw(20) << "allocated_bytes" << std::right << std::setw(12) << x.allocated_bytes << std::endl;
+    return os;
+}
+
+#endif
@@ -0,0 +1,116 @@
+#ifndef BOUNDED_QUEUE_H
+#define BOUNDED_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include "memtrace.h"
+
+/**
+ * Bounded lock-free multi-producer multi-consumer queue (D. Vyukov's array based queue).
+ * Every cell has a sequence number that tells whether it's ready to be written or read
+ * in the current round, so producers and consumers only compete for the head and tail indices.
+ * @tparam T the stored type, it has to be default constructible and copyable
+ */
+template <typename T>
+class BoundedQueue
+{
+    struct cell
+    {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+    cell *cells;
+    // capacity - 1, the capacity is a power of 2
+    size_t mask;
+    // producers and consumers are kept on separate cache lines
+    alignas(64) std::atomic<size_t> tail;
+    alignas(64) std::atomic<size_t> head;
+
+    BoundedQueue(const BoundedQueue &);
+    BoundedQueue &operator=(const BoundedQueue &);
+
+public:
+    // the capacity is rounded up to the nearest power of 2
+    BoundedQueue(const size_t &);
+    size_t capacity() const { return mask + 1; }
+    // returns false if the queue is full
+    bool push(const T &);
+    // returns false if the queue is empty
+    bool pop(T &);
+    ~BoundedQueue();
+};
+
+/**
+ * @param n the minimum number of elements the queue can hold
+ */
+template <typename T>
+BoundedQueue<T>::BoundedQueue(const size_t &n) : tail(0), head(0)
+{
+    size_t size = 2;
+    while (size < n)
+        size <<= 1;
+    mask = size - 1;
+    cells = new cell[size];
+    for (size_t i = 0; i < size; ++i)
+        cells[i].sequence.store(i, std::memory_order_relaxed);
+}
+
+template <typename T>
+bool BoundedQueue<T>::push(const T &x)
+{
+    size_t pos = tail.load(std::memory_order_relaxed);
+    while (true)
+    {
+        cell *c = &cells[pos & mask];
+        size_t seq = c->sequence.load(std::memory_order_acquire);
+        // the cell is free in this round
+        if (seq == pos)
+        {
+            if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+            {
+                c->value = x;
+                c->sequence.store(pos + 1, std::memory_order_release);
+                return true;
+            }
+        }
+        // the cell still holds the value of the previous round
+        else if (seq < pos)
+            return false;
+        else
+            pos = tail.load(std::memory_order_relaxed);
+    }
+}
+
+template <typename T>
+bool BoundedQueue<T>::pop(T &x)
+{
+    size_t pos = head.load(std::memory_order_relaxed);
+    while (true)
+    {
+        cell *c = &cells[pos & mask];
+        size_t seq = c->sequence.load(std::memory_order_acquire);
+        // the cell has been written in this round
+        if (seq == pos + 1)
+        {
+            if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+            {
+                x = c->value;
+                c->sequence.store(pos + mask + 1, std::memory_order_release);
+                return true;
+            }
+        }
+        // nothing has been written to the cell yet
+        else if (seq < pos + 1)
+            return false;
+        else
+            pos = head.load(std::memory_order_relaxed);
+    }
+}
+
+template <typename T>
+BoundedQueue<T>::~BoundedQueue()
+{
+    delete[] cells;
+}
+
+#endif
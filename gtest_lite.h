@@ -12,6 +12,8 @@
  * Sz.I. 2021 EXPEXT_REGEXP, CREATE_Has_fn_, cmp w. NULL, EXPECT_ param fix
  * V.B., Sz.I. 2022 almostEQ fix,
  * Sz.I. 2022. EXPECT_THROW fix
+ * 2026 tesztenkénti időmérés, BENCHMARK, EXPECT_FASTER_THAN, EXPECT_MAX_ALLOCS
+ * 2026 REGISTER_TEST, RUN_ALL_TESTS: párhuzamos futtatás külön folyamatokban
  *
  * A tesztelés legalapvetőbb funkcióit támogató függvények és makrók.
  * Nem szálbiztos megvalósítás.
@@ -38,6 +40,22 @@
  *     ...
  *   END
  *  ...
+ * // Teljesítménymérés és -korlátok. A makrók után blokk áll, amit a makró futtat:
+ *   TEST(TeszEsetNeve, TesztNeve)
+ *     BENCHMARK(f, 1000) { f(2); }             // bemelegítés után 1000-szer futtatja, statisztikát ír
+ *     EXPECT_FASTER_THAN(1000000) { f(2); }    // 1 ms-nál (1000000 ns) gyorsabbnak kell lennie
+ *     EXPECT_MAX_ALLOCS(0) { f(2); }           // nem foglalhat memóriát (MEMTRACE kell hozzá)
+ *   END
+ *  ...
+ * // Regisztrált tesztek: a main előtt, függvényként kell megírni őket, a RUN_ALL_TESTS() futtatja
+ * // mindegyiket külön gyerekfolyamatban, párhuzamosan, időkorláttal:
+ * REGISTER_TEST(TeszEsetNeve, TesztNeve) {
+ *     EXPECT_EQ(4, f(2));
+ * }
+ * int main() {
+ *     ...
+ *     RUN_ALL_TESTS();
+ * }
  *
  * A működés részleteinek megértése szorgalmi feladat.
  */
@@ -53,6 +71,19 @@
 #if __cplusplus >= 201103L
 # include <iterator>
 # include <regex>
+# include <algorithm>
+# include <chrono>
+# include <cstdio>
+# include <ctime>
+# include <vector>
+# include <thread>
+# if defined(__unix__) || defined(__APPLE__)
+#  define GTEST_LITE_FORK
+#  include <poll.h>
+#  include <signal.h>
+#  include <sys/wait.h>
+#  include <unistd.h>
+# endif
 #endif
 #ifdef MEMTRACE
 # include "memtrace.h"
@@ -170,6 +201,30 @@
 #if __cplusplus >= 201103L
 /// Reguláris kifejezés illesztése
 # define EXPECT_REGEXP(expected, actual, match, err) gtest_lite::EXPECTREGEXP(expected, actual, match, err, __FILE__, __LINE__, "EXPECT_REGEXP(" #expected ", " #actual ", " #match ")" )
+
+/// Teljesítménymérés: a mögötte álló blokkot bemelegítés után iterations-szer futtatja,
+/// és kiírja a futási idők statisztikáját. Az eredmény a gtest_lite::test.bench-ben marad. -- ilyen nincs a gtest-ben
+# define BENCHMARK(N, iterations) for (gtest_lite::Benchmark gtest_lite_bench(#N, iterations); gtest_lite_bench.next(); )
+
+/// A mögötte álló blokknak ns nanoszekundumnál rövidebb idő alatt kell lefutnia -- ilyen nincs a gtest-ben
+/// A blokkból nem szabad break-kel kilépni, mert akkor elmarad az ellenőrzés.
+# define EXPECT_FASTER_THAN(ns) for (gtest_lite::TimeLimit gtest_lite_limit(ns, __FILE__, __LINE__, "EXPECT_FASTER_THAN(" #ns ")"); gtest_lite_limit.next(); )
+#endif
+
+/// A mögötte álló blokk legfeljebb n foglalást végezhet (memtrace::allocation_count() szerint) -- ilyen nincs a gtest-ben
+/// MEMTRACE nélkül csak lefuttatja a blokkot. A blokkból nem szabad break-kel kilépni.
+#define EXPECT_MAX_ALLOCS(n) for (gtest_lite::AllocLimit gtest_lite_allocs(n, __FILE__, __LINE__, "EXPECT_MAX_ALLOCS(" #n ")"); gtest_lite_allocs.next(); )
+
+#if __cplusplus >= 201103L
+/// Regisztrált teszt: nem fut azonnal, hanem a RUN_ALL_TESTS() futtatja. -- ilyen nincs a gtest_lite-ban
+/// Névtér szinten kell használni, a függvénytörzs követi, END nem kell.
+/// Az ASSERT_ makrók itt nem használhatók, return-nel lehet kilépni.
+# define REGISTER_TEST(C, N) GTEST_LITE_REGISTER_(#C "." #N, GTEST_LITE_CAT_(gtest_lite_test_, __LINE__))
+
+/// A regisztrált tesztek futtatása, a hibás tesztek számával tér vissza.
+/// A párhuzamos folyamatok száma (GTEST_LITE_JOBS) és a tesztenkénti időkorlát másodpercben
+/// (GTEST_LITE_TIMEOUT) környezeti változóval állítható.
+# define RUN_ALL_TESTS() gtest_lite::run_registered()
 #endif
 ////--------------------------------------------------------------------------------------------
 /// ASSERT típusú ellenőrzések. CSak 1-2 van megvalósítva. Nem ostream& -val térnek vissza !!!
@@ -237,6 +292,12 @@ struct _Is_Types {
 #define ASSERT_(expected, actual, fn, op) EXPECT_(expected, actual, fn, __FILE__, __LINE__, #op "(" #expected ", " #actual ")" ); \
     if (!gtest_lite::test.status) { gtest_lite::test.end(); break; }
 
+#define GTEST_LITE_CAT_(a, b) GTEST_LITE_CAT2_(a, b)
+#define GTEST_LITE_CAT2_(a, b) a##b
+#define GTEST_LITE_REGISTER_(name, F) static void F(); \
+    static gtest_lite::Registrar GTEST_LITE_CAT_(F, _registrar)(name, F); \
+    static void F()
+
 #ifdef CPORTA
 #define GTINIT(is)  \
     int magic;      \
@@ -255,6 +316,30 @@ struct _Is_Types {
 /// gtest_lite: a keretrendszer függvényinek és objektumainak névtere
 namespace gtest_lite {
 
+#if __cplusplus >= 201103L
+/// A legutóbbi BENCHMARK eredménye, az idők ns-ban
+struct BenchmarkResult {
+    std::string name;
+    int iterations;
+    double min, median, mean, stddev, max;
+    BenchmarkResult() :iterations(0), min(0), median(0), mean(0), stddev(0), max(0) {}
+};
+
+/// ns-ban megadott időt ír ki olvasható mértékegységgel
+inline std::string format_ns(double ns) {
+    char buf[32];
+    if (ns < 1e3)
+        std::snprintf(buf, sizeof(buf), "%.0f ns", ns);
+    else if (ns < 1e6)
+        std::snprintf(buf, sizeof(buf), "%.2f us", ns / 1e3);
+    else if (ns < 1e9)
+        std::snprintf(buf, sizeof(buf), "%.2f ms", ns / 1e6);
+    else
+        std::snprintf(buf, sizeof(buf), "%.2f s", ns / 1e9);
+    return buf;
+}
+#endif
+
 /// Tesztek állapotát tároló osztály.
 /// Egyetlen egy statikus példány keletkezik, aminek a
 /// destruktora a futás végén hívódik meg.
@@ -267,6 +352,13 @@ struct Test {
     std::string name;   ///< éppen futó teszt neve
     std::fstream null;  ///< nyelő, ha nem kell kiírni semmit
     std::ostream& os;   ///< ide írunk
+#if __cplusplus >= 201103L
+    std::chrono::steady_clock::time_point wall_start; ///< a teszt kezdete
+    std::clock_t cpu_start;                           ///< a folyamat CPU ideje a teszt kezdetén
+    double wall_ns;     ///< a legutóbbi teszt ideje
+    double cpu_ns;      ///< a legutóbbi teszt alatt a folyamat (minden szála) által használt CPU idő
+    BenchmarkResult bench; ///< a legutóbbi BENCHMARK eredménye
+#endif
     static Test& getTest() {
         static Test instance;///< egyedüli (singleton) példány
         return instance;
@@ -284,9 +376,20 @@ public:
 #endif
         os << "\n---> " << name << std::endl;
         ++sum;
+#if __cplusplus >= 201103L
+        cpu_start = std::clock();
+        wall_start = std::chrono::steady_clock::now();
+#endif
     }
     /// Teszt vége
     std::ostream& end(bool memchk = false) {
+#if __cplusplus >= 201103L
+        wall_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - wall_start).count();
+        cpu_ns = (double)(std::clock() - cpu_start) * 1e9 / CLOCKS_PER_SEC;
+#ifndef CPORTA
+        os << "     ido: " << format_ns(wall_ns) << " (cpu: " << format_ns(cpu_ns) << ")" << std::endl;
+#endif
+#endif
 #ifdef MEMTRACE
         if (memchk && ablocks != memtrace::allocated_blocks()) {
             status = false;
@@ -340,6 +443,290 @@ public:
 /// mindegyik egyetlen példányra fog hivatkozni a singleton minta miatt
 static Test& test = Test::getTest();
 
+#if __cplusplus >= 201103L
+/// A BENCHMARK makró segédosztálya.
+/// A next() minden iteráció előtt hívódik, két hívás között telt idő egy iteráció ideje.
+class Benchmark {
+    const char *name;
+    int iterations;
+    int i;              ///< negatív a bemelegítés alatt, utána a lemért iterációk száma
+    std::vector<double> samples;
+    std::chrono::steady_clock::time_point last;
+public:
+    Benchmark(const char *name, int iterations)
+        : name(name), iterations(iterations > 0 ? iterations : 1), i(-std::max(1, iterations / 10)) {
+        samples.reserve(this->iterations);
+    }
+
+    bool next() {
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        if (i > 0)
+            samples.push_back(std::chrono::duration<double, std::nano>(now - last).count());
+        if (i == iterations) {
+            report();
+            return false;
+        }
+        ++i;
+        last = std::chrono::steady_clock::now();
+        return true;
+    }
+
+    void report() {
+        BenchmarkResult& r = test.bench;
+        std::sort(samples.begin(), samples.end());
+        r.name = name;
+        r.iterations = iterations;
+        r.min = samples.front();
+        r.max = samples.back();
+        r.median = samples[samples.size() / 2];
+        r.mean = 0;
+        for (size_t k = 0; k < samples.size(); ++k)
+            r.mean += samples[k];
+        r.mean /= samples.size();
+        r.stddev = 0;
+        for (size_t k = 0; k < samples.size(); ++k)
+            r.stddev += (samples[k] - r.mean) * (samples[k] - r.mean);
+        r.stddev = std::sqrt(r.stddev / samples.size());
+        test.os << "     BENCHMARK " << name << ": " << iterations << " iteracio, min " << format_ns(r.min)
+                << ", median " << format_ns(r.median) << ", atlag " << format_ns(r.mean)
+                << ", szoras " << format_ns(r.stddev) << ", max " << format_ns(r.max) << std::endl;
+    }
+};
+
+/// Az EXPECT_FASTER_THAN makró segédosztálya: az első next() indítja, a második ellenőrzi az órát.
+class TimeLimit {
+    double limit;
+    const char *file;
+    int line;
+    const char *expr;
+    bool started;
+    std::chrono::steady_clock::time_point start;
+public:
+    TimeLimit(double limit, const char *file, int line, const char *expr)
+        : limit(limit), file(file), line(line), expr(expr), started(false) {}
+
+    bool next() {
+        if (!started) {
+            started = true;
+            start = std::chrono::steady_clock::now();
+            return true;
+        }
+        double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        test.expect(ns < limit, file, line, expr)
+            << "** limit: " << format_ns(limit)
+            << "\n** aktual: " << format_ns(ns) << std::endl;
+        return false;
+    }
+};
+#endif
+
+/// Az EXPECT_MAX_ALLOCS makró segédosztálya: az első next() megjegyzi a foglalások számát, a második ellenőrzi.
+/// Csak a tesztelő szál foglalásai számítanak, a háttérszálaké (ThreadPool, KeyPool) nem.
+class AllocLimit {
+    unsigned long limit;
+    const char *file;
+    int line;
+    const char *expr;
+    bool started;
+    unsigned long start;
+public:
+    AllocLimit(unsigned long limit, const char *file, int line, const char *expr)
+        : limit(limit), file(file), line(line), expr(expr), started(false), start(0) {}
+
+    bool next() {
+        if (!started) {
+            started = true;
+#ifdef MEMTRACE
+            start = memtrace::thread_allocation_count();
+#endif
+            return true;
+        }
+#ifdef MEMTRACE
+        unsigned long allocs = memtrace::thread_allocation_count() - start;
+        test.expect(allocs <= limit, file, line, expr)
+            << "** limit: " << limit
+            << "\n** aktual: " << allocs << std::endl;
+#endif
+        return false;
+    }
+};
+
+#if __cplusplus >= 201103L
+/// Regisztrált teszt
+struct RegisteredTest {
+    const char *name;
+    void (*fn)();
+};
+
+/// A regisztrált tesztek a regisztrálás sorrendjében
+inline std::vector<RegisteredTest>& registry() {
+    static std::vector<RegisteredTest> tests;
+    return tests;
+}
+
+/// A REGISTER_TEST makró segédosztálya: a statikus példány konstruktora veszi fel a tesztet.
+struct Registrar {
+    Registrar(const char *name, void (*fn)()) {
+        RegisteredTest t = {name, fn};
+        registry().push_back(t);
+    }
+};
+
+/// Egy regisztrált teszt futtatása ebben a folyamatban
+inline void run_one(const RegisteredTest& t) {
+    test.begin(t.name);
+    try {
+        t.fn();
+    } catch (std::exception& e) {
+        test.expect(false, __FILE__, __LINE__, t.name) << "** nem kezelt kivetel: " << e.what() << std::endl;
+    } catch (...) {
+        test.expect(false, __FILE__, __LINE__, t.name) << "** nem kezelt kivetel" << std::endl;
+    }
+    test.end();
+}
+
+/// A regisztrált tesztek futtatása legfeljebb jobs párhuzamos gyerekfolyamatban.
+/// Minden teszt kimenetét összegyűjti, és a regisztrálás sorrendjében írja ki.
+/// A timeout másodpercnél tovább futó tesztet leállítja és hibásnak veszi.
+/// Folyamatok nélkül (nem POSIX rendszeren) egymás után, ebben a folyamatban futtatja őket.
+/// @return a hibás tesztek száma
+inline int run_registered(unsigned int jobs = 0, unsigned int timeout = 0) {
+    std::vector<RegisteredTest>& tests = registry();
+    if (const char *env = std::getenv("GTEST_LITE_JOBS"))
+        jobs = std::atoi(env);
+    if (const char *env = std::getenv("GTEST_LITE_TIMEOUT"))
+        timeout = std::atoi(env);
+    if (jobs == 0)
+        jobs = std::max(1u, std::thread::hardware_concurrency());
+    if (timeout == 0)
+        timeout = 300;
+    int failed_tests = 0;
+#ifdef GTEST_LITE_FORK
+    struct Job {
+        pid_t pid;
+        int fd;
+        size_t index;
+        std::chrono::steady_clock::time_point start;
+        bool timed_out;
+    };
+    std::vector<std::string> output(tests.size());
+    std::vector<bool> done(tests.size(), false);
+    std::vector<Job> running;
+    size_t next = 0, printed = 0;
+    test.os << "\n==== " << tests.size() << " regisztralt teszt, " << jobs << " folyamatban ====" << std::endl;
+    while (printed < tests.size()) {
+        while (running.size() < jobs && next < tests.size()) {
+            int fds[2];
+            pid_t pid = -1;
+            // a pufferelt kimenet ne duplázódjon meg a gyerekben
+            test.os.flush();
+            std::cerr.flush();
+            std::fflush(NULL);
+            if (pipe(fds) == 0 && (pid = fork()) < 0) {
+                close(fds[0]);
+                close(fds[1]);
+            }
+            if (pid < 0) {
+                if (!running.empty())
+                    break;
+                // ha nem indul folyamat, akkor ebben futtatjuk
+                while (printed < next)
+                    test.os << output[printed++];
+                int before = test.failed;
+                run_one(tests[next]);
+                if (test.failed != before)
+                    ++failed_tests;
+                done[next++] = true;
+                ++printed;
+                continue;
+            }
+            if (pid == 0) {
+                close(fds[0]);
+                dup2(fds[1], 1);
+                dup2(fds[1], 2);
+                close(fds[1]);
+                int before = test.failed;
+                run_one(tests[next]);
+                test.os.flush();
+                std::cerr.flush();
+                std::fflush(NULL);
+                // a kilépési kód a hibás ellenőrzések száma, az atexit kezelők (memtrace riport) nem futnak
+                _exit(std::min(test.failed - before, 100));
+            }
+            close(fds[1]);
+            Job job = {pid, fds[0], next, std::chrono::steady_clock::now(), false};
+            running.push_back(job);
+            ++next;
+        }
+        if (running.empty())
+            break;
+        std::vector<pollfd> polls(running.size());
+        for (size_t k = 0; k < running.size(); ++k) {
+            polls[k].fd = running[k].fd;
+            polls[k].events = POLLIN;
+            polls[k].revents = 0;
+        }
+        poll(polls.data(), polls.size(), 100);
+        for (size_t k = running.size(); k-- > 0;) {
+            Job& job = running[k];
+            bool finished = false;
+            if (polls[k].revents & (POLLIN | POLLHUP | POLLERR)) {
+                char buf[4096];
+                ssize_t n = read(job.fd, buf, sizeof(buf));
+                if (n > 0)
+                    output[job.index].append(buf, n);
+                else
+                    finished = true;
+            }
+            if (!finished && std::chrono::steady_clock::now() - job.start > std::chrono::seconds(timeout)) {
+                kill(job.pid, SIGKILL);
+                job.timed_out = true;
+                finished = true;
+            }
+            if (!finished)
+                continue;
+            close(job.fd);
+            int status = 0;
+            waitpid(job.pid, &status, 0);
+            std::string& out = output[job.index];
+            const char *name = tests[job.index].name;
+            ++test.sum;
+            if (WIFEXITED(status) && WEXITSTATUS(status) <= 100) {
+                test.failed += WEXITSTATUS(status);
+                if (WEXITSTATUS(status) != 0)
+                    ++failed_tests;
+            } else {
+                ++test.failed;
+                ++failed_tests;
+                std::string reason;
+                if (job.timed_out)
+                    reason = "idotullepes (" + std::to_string(timeout) + " s)";
+                else if (WIFSIGNALED(status))
+                    reason = "jelzes: " + std::to_string(WTERMSIG(status));
+                else
+                    reason = "kilepesi kod: " + std::to_string(WEXITSTATUS(status));
+                out += std::string("** HIBAS ****\t") + name + " <--- " + reason + "\n";
+            }
+            done[job.index] = true;
+            running.erase(running.begin() + k);
+        }
+        while (printed < tests.size() && done[printed])
+            test.os << output[printed++] << std::flush;
+    }
+#else
+    (void)jobs;
+    (void)timeout;
+    for (size_t i = 0; i < tests.size(); ++i) {
+        int before = test.failed;
+        run_one(tests[i]);
+        if (test.failed != before)
+            ++failed_tests;
+    }
+#endif
+    return failed_tests;
+}
+#endif
+
 /// általános sablon a várt értékhez.
 template <typename T1, typename T2>
 std::ostream& EXPECT_(T1 exp, T2 act, bool (*pred)(T1, T1), const char *file, int line,
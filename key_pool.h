@@ -0,0 +1,177 @@
+#ifndef KEY_POOL_H
+#define KEY_POOL_H
+
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <vector>
+#include <memory>
+#include <stdexcept>
+#include "rsa_key.h"
+#include "bounded_queue.h"
+#include "memtrace.h"
+
+/**
+ * Keeps pre-generated key pairs so that the request path never has to wait for key generation.
+ * Background threads generate new key pairs whenever the number of stored pairs drops below
+ * the low-water mark and keep generating until it's reached again.
+ * Taking a key pair out of the pool is lock-free.
+ */
+class KeyPool
+{
+    BoundedQueue<RsaKeyPair *> queue;
+    const size_t low_water;
+    const exponent_mode mode;
+    // stored key pairs and the ones currently being generated
+    std::atomic<size_t> stored;
+    std::atomic<size_t> generating;
+    std::atomic<unsigned long> hit_count;
+    std::atomic<unsigned long> miss_count;
+    std::vector<std::thread> refillers;
+    std::mutex state_lock;
+    // wakes the refill threads
+    std::condition_variable refill;
+    // wakes the threads blocked in acquire
+    std::condition_variable available;
+    bool stopping;
+
+    KeyPool(const KeyPool &);
+    KeyPool &operator=(const KeyPool &);
+    static size_t checked_low_water(const size_t &, const size_t &);
+    void refill_loop();
+    RsaKeyPair *pop();
+
+public:
+    KeyPool(const size_t &, const size_t &, const unsigned int & = 1, const exponent_mode & = fixed_exponent);
+    // waits until a key pair is available
+    std::unique_ptr<RsaKeyPair> acquire();
+    // returns an empty pointer if there is no key pair available
+    std::unique_ptr<RsaKeyPair> try_acquire();
+    // the number of acquires that found a key pair immediately
+    unsigned long hits() const { return hit_count; }
+    // the number of acquires that found the pool empty
+    unsigned long misses() const { return miss_count; }
+    size_t size() const { return stored; }
+    // waits for the key pairs under generation, then frees the stored ones
+    ~KeyPool();
+};
+
+/**
+ * @param capacity the maximum number of stored key pairs
+ * @param low_water the pool is refilled up to this number of key pairs, 1 <= low_water <= capacity
+ * @param threads the number of background threads generating key pairs
+ * @param mode passed to the RsaKeyPair constructor
+ * @throw std::invalid_argument if low_water is 0 or more than capacity
+ */
+inline KeyPool::KeyPool(const size_t &capacity, const size_t &low_water, const unsigned int &threads, const exponent_mode &mode)
+    : queue(capacity), low_water(checked_low_water(capacity, low_water)), mode(mode),
+      stored(0), generating(0), hit_count(0), miss_count(0), stopping(false)
+{
+    for (unsigned int i = 0; i < (threads != 0 ? threads : 1); ++i)
+        refillers.push_back(std::thread(&KeyPool::refill_loop, this));
+}
+
+/**
+ * With a low-water mark of 0 nothing is ever generated and acquire would wait forever,
+ * above the capacity the refilled pairs wouldn't fit into the queue.
+ * @return low_water if it's valid
+ */
+inline size_t KeyPool::checked_low_water(const size_t &capacity, const size_t &low_water)
+{
+    if (low_water == 0 || low_water > capacity)
+        throw std::invalid_argument("KeyPool low-water mark has to be between 1 and the capacity");
+    return low_water;
+}
+
+inline void KeyPool::refill_loop()
+{
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> guard(state_lock);
+            refill.wait(guard, [this] { return stopping || stored + generating < low_water; });
+            if (stopping)
+                return;
+            ++generating;
+        }
+        RsaKeyPair *keys = new RsaKeyPair(mode);
+        {
+            std::lock_guard<std::mutex> guard(state_lock);
+            // counted before it's published: a lock-free pop may take it right away,
+            // and stored must not go below zero then
+            ++stored;
+            --generating;
+            // the low-water mark is never above the capacity, so there's always room
+            queue.push(keys);
+        }
+        available.notify_one();
+    }
+}
+
+/**
+ * Takes a key pair out of the queue and wakes the refill threads if it went below the low-water mark.
+ * @return NULL if the queue is empty
+ */
+inline RsaKeyPair *KeyPool::pop()
+{
+    RsaKeyPair *keys;
+    if (!queue.pop(keys))
+        return NULL;
+    if (--stored < low_water)
+    {
+        // taking the lock makes sure a refill thread can't miss the notification
+        {
+            std::lock_guard<std::mutex> guard(state_lock);
+        }
+        refill.notify_one();
+    }
+    return keys;
+}
+
+inline std::unique_ptr<RsaKeyPair> KeyPool::try_acquire()
+{
+    RsaKeyPair *keys = pop();
+    if (keys != NULL)
+        ++hit_count;
+    else
+        ++miss_count;
+    return std::unique_ptr<RsaKeyPair>(keys);
+}
+
+inline std::unique_ptr<RsaKeyPair> KeyPool::acquire()
+{
+    RsaKeyPair *keys = pop();
+    if (keys != NULL)
+    {
+        ++hit_count;
+        return std::unique_ptr<RsaKeyPair>(keys);
+    }
+    ++miss_count;
+    while (keys == NULL)
+    {
+        {
+            std::unique_lock<std::mutex> guard(state_lock);
+            available.wait(guard, [this] { return stored != 0; });
+        }
+        // another thread may take it first, then we wait again
+        keys = pop();
+    }
+    return std::unique_ptr<RsaKeyPair>(keys);
+}
+
+inline KeyPool::~KeyPool()
+{
+    {
+        std::lock_guard<std::mutex> guard(state_lock);
+        stopping = true;
+    }
+    refill.notify_all();
+    for (size_t i = 0; i < refillers.size(); ++i)
+        refillers[i].join();
+    RsaKeyPair *keys;
+    while (queue.pop(keys))
+        delete keys;
+}
+
+#endif
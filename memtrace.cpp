@@ -8,6 +8,10 @@ mem_dump:   2016.
 memset felszabaditaskor: 2018.
 typo:       2019.
 poi_check:  2021.
+hash tabla: 2026.
+profil:     2026.
+mintavetel: 2026.
+binaris nyomkovetes: 2026.
 *********************************/
 
 /*definialni kell, ha nem paracssorbol allitjuk be (-DMEMTRACE) */
@@ -27,6 +31,37 @@ poi_check:  2021.
 #define FROM_MEMTRACE_CPP
 #include "memtrace.h"
 
+#ifdef MEMTRACE_BINARY
+	#include "memtrace_trace.h"
+	#if defined(__unix__) || defined(__APPLE__)
+		/* a nyomkoveto fajl memoriaba van lekepezve, igy a kernel irja ki, akkor is, ha a program elszall */
+		#define TRACE_MMAP
+		#include <sys/mman.h>
+		#include <fcntl.h>
+		#include <unistd.h>
+	#endif
+#endif
+
+#if defined(__cplusplus) && __cplusplus >= 201103L
+	/* tobb szalbol is hasznalhato: a nyilvantartas cim szerint reszekre (shard) van osztva, */
+	/* mindegyik reszt kulon mutex vedi, igy a szalak ritkan varnak egymasra */
+	#include <mutex>
+	#include <atomic>
+	#include <chrono>
+	#define REGISTRY_LOCK std::lock_guard<std::recursive_mutex> registry_guard(memtrace::registry_mutex())
+	#define SHARD_LOCK(s) std::lock_guard<std::recursive_mutex> shard_guard(memtrace::shard_mutex(s))
+	#define THREAD_LOCAL thread_local
+	#define ATOMIC(type) std::atomic<type>
+#else
+	#define REGISTRY_LOCK
+	#define SHARD_LOCK(s)
+	#define THREAD_LOCAL
+	#define ATOMIC(type) type
+#endif
+
+/* a reszek szama, 2 hatvanya */
+#define REGISTRY_SHARDS 16
+
 #define FMALLOC 0
 #define FCALLOC 1
 #define FREALLOC 2
@@ -160,7 +195,41 @@ START_NAMESPACE
 	    dump_memory(mem, size, 0, fp);
     }
 
-	static BOOL dying;
+#if defined(MEMTRACE_PROFILE) || defined(MEMTRACE_BINARY)
+	static unsigned long long now_ns(void) {
+	#if defined(__cplusplus) && __cplusplus >= 201103L
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	#else
+		return (unsigned long long)clock() * (1000000000ULL / CLOCKS_PER_SEC);
+	#endif
+	}
+#endif
+
+	static ATOMIC(BOOL) dying;
+
+#if defined(__cplusplus) && __cplusplus >= 201103L
+	/* rekurziv, mert a die() alatt is foglalhatunk; soha nem szunik meg, igy kilepeskor is hasznalhato */
+#ifdef MEMTRACE_TO_FILE
+	/* a nyomkoveto fajlt vedi */
+	static std::recursive_mutex& registry_mutex() {
+		alignas(std::recursive_mutex) static unsigned char buf[sizeof(std::recursive_mutex)];
+		static std::recursive_mutex *m = ::new (buf) std::recursive_mutex;
+		return *m;
+	}
+#endif
+
+	/* reszenkent egy mutex, ezek sem szunnek meg soha */
+	static std::recursive_mutex& shard_mutex(size_t i) {
+		alignas(std::recursive_mutex) static unsigned char buf[REGISTRY_SHARDS][sizeof(std::recursive_mutex)];
+		static BOOL created = [] {
+			for (size_t k = 0; k < REGISTRY_SHARDS; k++)
+				::new (buf[k]) std::recursive_mutex;
+			return TRUE;
+		}();
+		(void)created;
+		return *reinterpret_cast<std::recursive_mutex*>(buf[i]);
+	}
+#endif
 
 	static void die(const char * msg, void * p, size_t size, call_t * a, call_t * d) {
 		#ifdef MEMTRACE_ERRFILE
@@ -180,6 +249,9 @@ START_NAMESPACE
 		exit(120);
 	}
 	static void initialize();
+	#ifdef MEMTRACE_SAMPLE
+	static BOOL is_untracked(void * pu);
+	#endif
 END_NAMESPACE
 
 /*******************************************************************/
@@ -189,47 +261,164 @@ END_NAMESPACE
 #ifdef MEMTRACE_TO_MEMORY
 START_NAMESPACE
 
-	typedef struct _registry_item {
-		void * p;    /* mem pointer*/
+	typedef struct {
+		void * p;    /* mem pointer, NULL ha a hely ures*/
 		size_t size; /* size*/
 		call_t call;
-		struct _registry_item * next;
+		unsigned long seq; /* foglalasi sorszam, a riport ebben a sorrendben irja ki */
+	#ifdef MEMTRACE_PROFILE
+		unsigned long long born; /* a foglalas ideje ns-ban */
+	#endif
 	} registry_item;
 
-	static registry_item registry; /*sentinel*/
+	/* nyilt cimzesu hash tabla, linearis probalassal, a kulcs a pointer */
+	typedef struct {
+		registry_item * items;
+		size_t cap;         /* mindig 2 hatvanya */
+		unsigned int bits;  /* log2(cap) */
+		size_t count;
+	} registry_shard;
+
+	/* minden pointer a cime alapjan egy reszbe kerul, a riport osszefesuli oket */
+	static registry_shard registry[REGISTRY_SHARDS];
+	static ATOMIC(unsigned long) registry_seq;
+
+	static size_t shard_index(void * p) {
+		return ((size_t)p >> 4) & (REGISTRY_SHARDS-1);
+	}
 
-	static registry_item *find_registry_item(void * p) {
-        registry_item *n = &registry;
-        for(; n->next && n->next->p != p ; n=n->next);
-        return n;
-    }
+	static size_t registry_hash(registry_shard * s, void * p) {
+		/* Fibonacci hash, az also bitek az igazitas miatt kevesse szorodnak */
+		return (size_t)(((unsigned long long)(size_t)p >> 4) * 11400714819323198485ULL >> (64 - s->bits));
+	}
 
-	static void print_registry_item(registry_item * p) {
-		if (p) {
-			print_registry_item(p->next);
-			fprintf(fperror, "\t%p%5d byte ",p->p, (int)p->size);
-			print_call(NULL, p->call);
-			if(p->call.par_txt) free(p->call.par_txt);
-			if(p->call.file) free(p->call.file);
-			free(p);
+	/* a pointerhez tartozo elem, vagy NULL */
+	static registry_item *find_registry_item(registry_shard * s, void * p) {
+		size_t i;
+		if (s->cap == 0) return NULL;
+		for (i = registry_hash(s, p); s->items[i].p != NULL; i = (i+1) & (s->cap-1))
+			if (s->items[i].p == p)
+				return &s->items[i];
+		return NULL;
+	}
+
+	static void put_registry_item(registry_shard * s, registry_item item) {
+		size_t i = registry_hash(s, item.p);
+		while (s->items[i].p != NULL)
+			i = (i+1) & (s->cap-1);
+		s->items[i] = item;
+	}
+
+	/* legfeljebb felig lehet tele, kulonben megduplazzuk */
+	static BOOL grow_registry(registry_shard * s) {
+		registry_item * old = s->items;
+		size_t old_cap = s->cap, i;
+		size_t cap = old_cap ? 2*old_cap : 256;
+		registry_item * n = (registry_item*)calloc(cap, sizeof(registry_item));
+		if (n == NULL) return FALSE;
+		s->items = n;
+		s->cap = cap;
+		for (s->bits = 0; ((size_t)1 << s->bits) < cap; s->bits++);
+		for (i = 0; i < old_cap; i++)
+			if (old[i].p != NULL)
+				put_registry_item(s, old[i]);
+		free(old);
+		return TRUE;
+	}
+
+	static BOOL insert_registry_item(registry_shard * s, registry_item item) {
+		if (2*(s->count+1) > s->cap && !grow_registry(s))
+			return FALSE;
+		item.seq = registry_seq++;
+		put_registry_item(s, item);
+		s->count++;
+		return TRUE;
+	}
+
+	/* torles hatrafele leptetessel, igy nem kell sirko (tombstone) */
+	static void remove_registry_item(registry_shard * s, registry_item * n) {
+		size_t hole = n - s->items, i = hole, home;
+		for (;;) {
+			i = (i+1) & (s->cap-1);
+			if (s->items[i].p == NULL) break;
+			home = registry_hash(s, s->items[i].p);
+			/* csak akkor leptetheto a lyukba, ha a lyuk a sajat helye es i kozott van */
+			if (((i - home) & (s->cap-1)) >= ((i - hole) & (s->cap-1))) {
+				s->items[hole] = s->items[i];
+				hole = i;
+			}
+		}
+		s->items[hole].p = NULL;
+		s->count--;
+	}
+
+	/* az osszes reszt zarolja, mindig ugyanabban a sorrendben */
+	static void lock_registry(void) {
+	#if defined(__cplusplus) && __cplusplus >= 201103L
+		for (size_t i = 0; i < REGISTRY_SHARDS; i++)
+			shard_mutex(i).lock();
+	#endif
+	}
+
+	static void unlock_registry(void) {
+	#if defined(__cplusplus) && __cplusplus >= 201103L
+		for (size_t i = REGISTRY_SHARDS; i-- > 0;)
+			shard_mutex(i).unlock();
+	#endif
+	}
+
+	static int compare_seq(const void * a, const void * b) {
+		unsigned long sa = (*(registry_item * const *)a)->seq, sb = (*(registry_item * const *)b)->seq;
+		return sa < sb ? -1 : sa > sb;
+	}
+
+	/* a szivargo blokkokat foglalasi sorrendben irja ki, majd kiuriti a tablakat; zarolt nyilvantartassal hivando */
+	static void print_registry(size_t count) {
+		size_t i, j, k = 0;
+		registry_item ** items = (registry_item**)malloc(count * sizeof(registry_item*));
+		for (j = 0; j < REGISTRY_SHARDS; j++)
+			for (i = 0; i < registry[j].cap; i++)
+				if (registry[j].items[i].p != NULL) {
+					if (items) items[k] = &registry[j].items[i];
+					k++;
+				}
+		if (items) qsort(items, k, sizeof(registry_item*), compare_seq);
+		for (i = 0; items && i < k; i++) {
+			fprintf(fperror, "\t%p%5d byte ",items[i]->p, (int)items[i]->size);
+			print_call(NULL, items[i]->call);
+		}
+		free(items);
+		for (j = 0; j < REGISTRY_SHARDS; j++) {
+			for (i = 0; i < registry[j].cap; i++)
+				if (registry[j].items[i].p != NULL) {
+					if(registry[j].items[i].call.par_txt) free(registry[j].items[i].call.par_txt);
+					if(registry[j].items[i].call.file) free(registry[j].items[i].call.file);
+					registry[j].items[i].p = NULL;
+				}
+			registry[j].count = 0;
 		}
 	}
 
 	/* ha nincs hiba, akkor 0-val tér vissza */
 	int mem_check(void) {
+		size_t count = 0, i;
 		initialize();
 		if(dying) return  2;    /* címzési hiba */
 
-		if(registry.next) {
+		lock_registry();
+		for (i = 0; i < REGISTRY_SHARDS; i++)
+			count += registry[i].count;
+		if(count) {
 			/*szivarog*/
 		    #ifdef MEMTRACE_ERRFILE
                 fperror = fopen(XSTR(MEMTRACE_ERRFILE), "w");
             #endif
 			fprintf(fperror, "Szivargas:\n");
-			print_registry_item(registry.next);
-			registry.next = NULL;
+			print_registry(count);
+			unlock_registry();
 			return 1;           /* memória fogyás */
 		}
+		unlock_registry();
         return 0;
 	}
 
@@ -237,18 +426,364 @@ START_NAMESPACE
 	int poi_check(void *pu) {
 	    if (pu == NULL) return 1;
 		initialize();
-        return find_registry_item(P(pu))->next != NULL;
+		#ifdef MEMTRACE_SAMPLE
+			if (is_untracked(pu)) return 1;
+		#endif
+		size_t s = shard_index(P(pu));
+		SHARD_LOCK(s);
+        return find_registry_item(&registry[s], P(pu)) != NULL;
 	}
 END_NAMESPACE
 #endif/*MEMTRACE_TO_MEMORY*/
 
+/*******************************************************************/
+/* MEMTRACE_PROFILE */
+/*******************************************************************/
+
+#ifdef MEMTRACE_PROFILE
+START_NAMESPACE
+
+	/* egy hivasi hely (fajl, sor, fuggveny) osszesitett adatai */
+	typedef struct {
+		char * file;   /* sajat masolat, NULL ha a hely ures vagy ismeretlen */
+		int line;
+		int f;
+		BOOL used;
+		unsigned long count;       /* foglalasok szama */
+		unsigned long freed;       /* felszabaditasok szama */
+		unsigned long long bytes;  /* osszes foglalt bajt */
+		unsigned long long live;   /* meg el bajt */
+		unsigned long long peak;   /* a legtobb egyszerre elo bajt */
+		unsigned long long lifetime; /* a felszabaditott blokkok osszes elettartama ns-ban */
+	} profile_site;
+
+	/* nyilt cimzesu hash tabla a hivasi helyeknek */
+	typedef struct {
+		profile_site * sites;
+		size_t cap;
+		size_t count;
+	} profile_shard;
+
+	/* a helyek a hash-uk szerint reszekre oszlanak, egy hely foglalasai es felszabaditasai mindig ugyanabba a reszbe esnek */
+	static profile_shard profile_shards[REGISTRY_SHARDS];
+
+#if defined(__cplusplus) && __cplusplus >= 201103L
+	/* reszenkent egy mutex, igy a profil nem sorositja ujra a regiszter reszeit */
+	static std::mutex& profile_mutex(size_t i) {
+		alignas(std::mutex) static unsigned char buf[REGISTRY_SHARDS][sizeof(std::mutex)];
+		static BOOL created = [] {
+			for (size_t k = 0; k < REGISTRY_SHARDS; k++)
+				::new (buf[k]) std::mutex;
+			return TRUE;
+		}();
+		(void)created;
+		return *reinterpret_cast<std::mutex*>(buf[i]);
+	}
+	#define PROFILE_LOCK(s) std::lock_guard<std::mutex> profile_guard(memtrace::profile_mutex(s))
+#else
+	#define PROFILE_LOCK(s)
+#endif
+
+	/* az osszes reszt zarolja, mindig ugyanabban a sorrendben */
+	static void lock_profile(void) {
+	#if defined(__cplusplus) && __cplusplus >= 201103L
+		for (size_t i = 0; i < REGISTRY_SHARDS; i++)
+			profile_mutex(i).lock();
+	#endif
+	}
+
+	static void unlock_profile(void) {
+	#if defined(__cplusplus) && __cplusplus >= 201103L
+		for (size_t i = REGISTRY_SHARDS; i-- > 0;)
+			profile_mutex(i).unlock();
+	#endif
+	}
+
+	static size_t site_hash(const char * file, int line, int f) {
+		size_t h = 5381;
+		if (file)
+			for (; *file; file++)
+				h = h * 33 + (unsigned char)*file;
+		return h * 31 + (size_t)line * 8 + (size_t)f;
+	}
+
+	/* az also bitek a reszt valasztjak, a tablan belul a tobbi bit szamit */
+	static size_t site_shard(const call_t * call) {
+		return site_hash(call->file, call->line, call->f) & (REGISTRY_SHARDS-1);
+	}
+
+	static BOOL site_equal(profile_site * s, const char * file, int line, int f) {
+		if (s->line != line || s->f != f) return FALSE;
+		if (s->file == NULL || file == NULL) return s->file == file ? TRUE : FALSE;
+		return strcmp(s->file, file) == 0 ? TRUE : FALSE;
+	}
+
+	/* a helyhez tartozo elem a resz tablajaban, ha meg nincs, letrehozza; a resz zarolasaval hivando */
+	static profile_site * find_site(profile_shard * t, const call_t * call) {
+		size_t i;
+		if (2*(t->count+1) > t->cap) {
+			profile_site * old = t->sites;
+			size_t old_cap = t->cap, k;
+			size_t cap = old_cap ? 2*old_cap : 64;
+			profile_site * n = (profile_site*)calloc(cap, sizeof(profile_site));
+			if (n == NULL) return NULL;
+			t->sites = n;
+			t->cap = cap;
+			for (k = 0; k < old_cap; k++)
+				if (old[k].used) {
+					for (i = site_hash(old[k].file, old[k].line, old[k].f) / REGISTRY_SHARDS & (cap-1); n[i].used; i = (i+1) & (cap-1));
+					n[i] = old[k];
+				}
+			free(old);
+		}
+		for (i = site_hash(call->file, call->line, call->f) / REGISTRY_SHARDS & (t->cap-1); t->sites[i].used; i = (i+1) & (t->cap-1))
+			if (site_equal(&t->sites[i], call->file, call->line, call->f))
+				return &t->sites[i];
+		t->sites[i].used = TRUE;
+		StrCpy(&t->sites[i].file, call->file);
+		t->sites[i].line = call->line;
+		t->sites[i].f = call->f;
+		t->count++;
+		return &t->sites[i];
+	}
+
+	static void profile_alloc(const call_t * call, size_t size) {
+		size_t r = site_shard(call);
+		PROFILE_LOCK(r);
+		profile_site * s = find_site(&profile_shards[r], call);
+		if (s == NULL) return;
+		s->count++;
+		s->bytes += size;
+		s->live += size;
+		if (s->live > s->peak) s->peak = s->live;
+	}
+
+	static void profile_free(const call_t * call, size_t size, unsigned long long born) {
+		size_t r = site_shard(call);
+		PROFILE_LOCK(r);
+		profile_site * s = find_site(&profile_shards[r], call);
+		if (s == NULL) return;
+		s->freed++;
+		s->live -= size;
+		s->lifetime += now_ns() - born;
+	}
+
+	static int compare_bytes(const void * a, const void * b) {
+		unsigned long long ba = (*(profile_site * const *)a)->bytes, bb = (*(profile_site * const *)b)->bytes;
+		return ba > bb ? -1 : ba < bb;
+	}
+
+	/* a legtobb bajtot foglalo top helyet irja ki */
+	void profile_report(unsigned int top, FILE * fp) {
+		size_t i, j, k = 0, count = 0;
+		profile_site ** list;
+		if (fp == NULL) fp = fperror;
+		lock_profile();
+		for (j = 0; j < REGISTRY_SHARDS; j++)
+			count += profile_shards[j].count;
+		list = (profile_site**)malloc((count ? count : 1) * sizeof(profile_site*));
+		if (list == NULL) {
+			unlock_profile();
+			return;
+		}
+		for (j = 0; j < REGISTRY_SHARDS; j++)
+			for (i = 0; i < profile_shards[j].cap; i++)
+				if (profile_shards[j].sites[i].used)
+					list[k++] = &profile_shards[j].sites[i];
+		qsort(list, k, sizeof(profile_site*), compare_bytes);
+		fprintf(fp, "Foglalasi helyek (%u/%u):\n", (unsigned int)(top < k ? top : k), (unsigned int)k);
+		fprintf(fp, "%10s %14s %12s %12s %14s  %s\n", "darab", "bajt", "el (bajt)", "csucs", "elettartam(us)", "hely");
+		for (i = 0; i < k && i < top; i++) {
+			profile_site * s = list[i];
+			fprintf(fp, "%10lu %14llu %12llu %12llu %14.1f  %s @ %s:%d\n", s->count, s->bytes, s->live, s->peak,
+				s->freed ? (double)s->lifetime / s->freed / 1000 : 0.0,
+				pretty[s->f], s->file ? basename(s->file) : "?", s->line);
+		}
+		free(list);
+		unlock_profile();
+	}
+
+	/* nullazza a szamlalokat, a meg elo blokkok bajtjai megmaradnak */
+	void profile_reset(void) {
+		size_t i, j;
+		lock_profile();
+		for (j = 0; j < REGISTRY_SHARDS; j++)
+			for (i = 0; i < profile_shards[j].cap; i++) {
+				profile_site * s = &profile_shards[j].sites[i];
+				if (s->used) {
+					s->count = s->freed = 0;
+					s->bytes = s->lifetime = 0;
+					s->peak = s->live;
+				}
+			}
+		unlock_profile();
+	}
+
+	static void profile_at_exit(void) {
+		profile_report(MEMTRACE_PROFILE_TOP, NULL);
+	}
+END_NAMESPACE
+#endif/*MEMTRACE_PROFILE*/
+
 /*******************************************************************/
 /* MEMTRACE_TO_FILE */
 /*******************************************************************/
 
 #ifdef MEMTRACE_TO_FILE
 START_NAMESPACE
+#ifndef MEMTRACE_BINARY
 	static FILE * trace_file;
+#else
+	/* a helytabla es a string tabla merete */
+	#define TRACE_SITES 65536
+	#define TRACE_STRINGS (1 << 20)
+
+	/* a lekepzett fajl reszei, trace_hdr NULL, ha nem sikerult megnyitni */
+	static memtrace_trace_header * trace_hdr;
+	static memtrace_event * trace_events;
+	static memtrace_site * trace_sites;
+	static char * trace_strings;
+	static size_t trace_len;
+	static unsigned long long trace_start;
+
+	/* hash tabla a helyekhez: hely index+1, 0 ha ures; a REGISTRY_LOCK vedi */
+	static uint32_t trace_site_index[2*TRACE_SITES];
+
+	/* szalankent a legutobb latott helyek, zar nelkul olvashato */
+	typedef struct {
+		size_t hash;
+		uint32_t site; /* hely index+1, 0 ha ures */
+	} trace_cache_item;
+	static THREAD_LOCAL trace_cache_item trace_cache[64];
+
+	static ATOMIC(unsigned int) trace_threads;
+	static THREAD_LOCAL unsigned int trace_thread; /* sorszam+1, 0 ha meg nincs */
+
+	static BOOL trace_site_equal(uint32_t site, const char * file, int line) {
+		memtrace_site * s = &trace_sites[site];
+		if (s->line != (uint32_t)line) return FALSE;
+		if (s->file == MEMTRACE_TRACE_NO_FILE || file == NULL)
+			return s->file == MEMTRACE_TRACE_NO_FILE && file == NULL ? TRUE : FALSE;
+		return strcmp(trace_strings + s->file, file) == 0 ? TRUE : FALSE;
+	}
+
+	/* a fajl:sor helyhez tartozo index, ha meg nincs, felveszi a helytablaba */
+	static uint32_t trace_site(const char * file, int line) {
+		size_t h = 5381, i;
+		const char * c;
+		trace_cache_item * ci;
+		if (file)
+			for (c = file; *c; c++)
+				h = h * 33 + (unsigned char)*c;
+		h = h * 31 + (size_t)line;
+		ci = &trace_cache[h & 63];
+		if (ci->site != 0 && ci->hash == h && trace_site_equal(ci->site-1, file, line))
+			return ci->site-1;
+
+		REGISTRY_LOCK;
+		for (i = h & (2*TRACE_SITES-1); trace_site_index[i]; i = (i+1) & (2*TRACE_SITES-1))
+			if (trace_site_equal(trace_site_index[i]-1, file, line))
+				break;
+		if (trace_site_index[i] == 0) {
+			size_t len = file ? strlen(file)+1 : 0;
+			memtrace_site * s;
+			if (trace_hdr->site_count >= TRACE_SITES || trace_hdr->strings_used + len > TRACE_STRINGS)
+				return MEMTRACE_TRACE_NO_SITE;
+			s = &trace_sites[trace_hdr->site_count];
+			s->line = (uint32_t)line;
+			s->file = MEMTRACE_TRACE_NO_FILE;
+			if (file) {
+				s->file = (uint32_t)trace_hdr->strings_used;
+				memcpy(trace_strings + trace_hdr->strings_used, file, len);
+				trace_hdr->strings_used += len;
+			}
+			trace_site_index[i] = (uint32_t)++trace_hdr->site_count;
+		}
+		ci->hash = h;
+		ci->site = trace_site_index[i];
+		return trace_site_index[i]-1;
+	}
+
+	/* a kovetkezo szabad hely a gyuruben */
+	static uint64_t trace_next(void) {
+	#if defined(__GNUC__)
+		return __atomic_fetch_add(&trace_hdr->head, 1, __ATOMIC_RELAXED);
+	#else
+		REGISTRY_LOCK;
+		return trace_hdr->head++;
+	#endif
+	}
+
+	static void trace_event(void * pu, size_t size, int kind, const call_t * call) {
+		memtrace_event * e;
+		if (trace_hdr == NULL) return;
+		if (trace_thread == 0) trace_thread = ++trace_threads;
+		e = &trace_events[trace_next() & (trace_hdr->events-1)];
+		e->time = now_ns() - trace_start;
+		e->ptr = (uint64_t)(size_t)pu;
+		e->size = size;
+		e->site = trace_site(call->file, call->line);
+		e->kind = (uint8_t)kind;
+		e->op = (uint8_t)call->f;
+		e->thread = (uint16_t)(trace_thread-1);
+	}
+
+#ifndef TRACE_MMAP
+	/* lekepzes hijan kilepeskor irjuk ki az egeszet */
+	static void trace_close(void) {
+		FILE * fp = fopen("memtrace.bin", "wb");
+		if (fp) {
+			fwrite(trace_hdr, 1, trace_len, fp);
+			fclose(fp);
+		}
+	}
+#endif
+
+	static void trace_open(void) {
+		size_t events_offset = (sizeof(memtrace_trace_header) + 63) & ~(size_t)63;
+		size_t sites_offset = events_offset + MEMTRACE_BINARY_EVENTS * sizeof(memtrace_event);
+		size_t strings_offset = sites_offset + TRACE_SITES * sizeof(memtrace_site);
+		memtrace_trace_header * hdr;
+		char * base;
+		trace_len = strings_offset + TRACE_STRINGS;
+	#ifdef TRACE_MMAP
+		{/*C-blokk*/
+			int fd = open("memtrace.bin", O_RDWR | O_CREAT | O_TRUNC, 0644);
+			base = NULL;
+			if (fd >= 0) {
+				if (ftruncate(fd, trace_len) == 0)
+					base = (char*)mmap(NULL, trace_len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+				close(fd);
+			}
+			if (base == (char*)MAP_FAILED) base = NULL;
+		}/*C-blokk*/
+	#else
+		base = (char*)calloc(1, trace_len);
+	#endif
+		if (base == NULL) {
+			fprintf(fperror, "memtrace.bin nem hozhato letre, nincs nyomkovetes\n");
+			return;
+		}
+		hdr = (memtrace_trace_header*)base;
+		memcpy(hdr->magic, MEMTRACE_TRACE_MAGIC, sizeof(hdr->magic));
+		hdr->event_size = sizeof(memtrace_event);
+		hdr->site_size = sizeof(memtrace_site);
+		hdr->events = MEMTRACE_BINARY_EVENTS;
+		hdr->sites = TRACE_SITES;
+		hdr->strings = TRACE_STRINGS;
+		hdr->events_offset = events_offset;
+		hdr->sites_offset = sites_offset;
+		hdr->strings_offset = strings_offset;
+		trace_events = (memtrace_event*)(base + events_offset);
+		trace_sites = (memtrace_site*)(base + sites_offset);
+		trace_strings = base + strings_offset;
+		trace_start = now_ns();
+		trace_hdr = hdr;
+	#ifndef TRACE_MMAP
+		atexit(trace_close);
+	#endif
+	}
+#endif/*MEMTRACE_BINARY*/
 END_NAMESPACE
 #endif
 
@@ -257,28 +792,56 @@ END_NAMESPACE
 /*******************************************************************/
 
 START_NAMESPACE
-	static int allocated_blks;
+	static ATOMIC(int) allocated_blks;
+	static ATOMIC(unsigned long) allocation_cnt;
+	/* a hivo szal foglalasai, a hatterszalak foglalasai nem szamitanak bele */
+	static THREAD_LOCAL unsigned long thread_allocation_cnt;
 
     int allocated_blocks() { return allocated_blks; }
 
+	unsigned long allocation_count() { return allocation_cnt; }
+
+	unsigned long thread_allocation_count() { return thread_allocation_cnt; }
+
+	#ifdef MEMTRACE_TO_MEMORY
+	static ATOMIC(size_t) live_bytes_cnt;
+
+	size_t live_bytes() { return live_bytes_cnt; }
+	#endif
+
 	static BOOL register_memory(void * p, size_t size, call_t call) {
 		initialize();
 		allocated_blks++;
-		#ifdef MEMTRACE_TO_FILE
+		allocation_cnt++;
+		thread_allocation_cnt++;
+		#if defined(MEMTRACE_BINARY)
+			trace_event(PU(p), size, MEMTRACE_TRACE_ALLOC, &call);
+		#elif defined(MEMTRACE_TO_FILE)
+		{/*C-blokk*/
+			REGISTRY_LOCK;
 			fprintf(trace_file, "%p\t%d\t%s%s", PU(p), (int)size, pretty[call.f], call.par_txt ? call.par_txt : "?");
 			if (call.f <= 3) fprintf(trace_file, ")");
 			fprintf(trace_file, "\t%d\t%s\n", call.line, call.file ? call.file : "?");
 			fflush(trace_file);
+		}/*C-blokk*/
 		#endif
 		#ifdef MEMTRACE_TO_MEMORY
 		{/*C-blokk*/
-			registry_item * n = (registry_item*)malloc(sizeof(registry_item));
-			if(n==NULL) return FALSE;
-			n->p = p;
-			n->size = size;
-			n->call = call;
-			n->next = registry.next;
-			registry.next = n;
+			size_t s = shard_index(p);
+			registry_item n;
+			n.p = p;
+			n.size = size;
+			n.call = call;
+			#ifdef MEMTRACE_PROFILE
+				n.born = now_ns();
+				profile_alloc(&call, size);
+			#endif
+			SHARD_LOCK(s);
+			if(!insert_registry_item(&registry[s], n)) {
+				allocated_blks--;
+				return FALSE;
+			}
+			live_bytes_cnt += size;
 		}/*C-blokk*/
 		#endif
 
@@ -287,19 +850,28 @@ START_NAMESPACE
 
 	static void unregister_memory(void * p, call_t call) {
 		initialize();
-		#ifdef MEMTRACE_TO_FILE
+		#if defined(MEMTRACE_BINARY)
+			trace_event(PU(p), 0, MEMTRACE_TRACE_FREE, &call);
+		#elif defined(MEMTRACE_TO_FILE)
+		{/*C-blokk*/
+			REGISTRY_LOCK;
                         fprintf(trace_file, "%p\t%d\t%s%s", PU(p), -1, pretty[call.f], call.par_txt ? call.par_txt : "?");
                         if (call.f <= 3) fprintf(trace_file, ")");
 			fprintf(trace_file,"\t%d\t%s\n",call.line, call.file ? call.file : "?");
 			fflush(trace_file);
+		}/*C-blokk*/
 		#endif
 		#ifdef MEMTRACE_TO_MEMORY
 		{ /*C-blokk*/
-			registry_item * n = find_registry_item(p);
-			if(n->next) {
+			size_t s = shard_index(p);
+			SHARD_LOCK(s);
+			registry_item * n = find_registry_item(&registry[s], p);
+			if(n) {
                 allocated_blks--;
-				registry_item * r = n->next;
-				n->next = r->next;
+				live_bytes_cnt -= n->size;
+				registry_item item = *n;
+				registry_item * r = &item;
+				remove_registry_item(&registry[s], n);
 				if(COMP(r->call.f,call.f)) {
                     int chk = chk_canary(r->p, r->size);
                     if (chk < 0)
@@ -307,13 +879,15 @@ START_NAMESPACE
                     if (chk > 0)
                         die("Blokk utan serult a memoria", r->p,r->size,&r->call,&call);
 					/*rendben van minden*/
+					#ifdef MEMTRACE_PROFILE
+						profile_free(&r->call, r->size, r->born);
+					#endif
 					if(call.par_txt) free(call.par_txt);
 					if(r->call.par_txt) free(r->call.par_txt);
 					if(call.file) free(call.file);
 					if(r->call.file) free(r->call.file);
 					memset(PU(r->p), 'f', r->size);
 					PU(r->p)[r->size-1] = 0;
-					free(r);
 				} else {
 					/*hibas felszabaditas*/
 					die("Hibas felszabaditas:",r->p,r->size,&r->call,&call);
@@ -326,6 +900,138 @@ START_NAMESPACE
 	}
 END_NAMESPACE
 
+/*******************************************************************/
+/* MEMTRACE_SAMPLE */
+/*******************************************************************/
+
+#ifdef MEMTRACE_SAMPLE
+START_NAMESPACE
+	/* a nem kovetett blokk elott csak a meret es egy jelzo all, kanari es nyilvantartas nincs */
+	static const size_t UNTRACKED_LEN = 2*sizeof(size_t);
+	static const size_t untracked_magic = (size_t)0x4d454d5452414345ULL; /* "MEMTRACE" */
+	#define UT_SIZE(pu)  (((size_t*)(pu))[-2])
+	#define UT_MAGIC(pu) (((size_t*)(pu))[-1])
+
+	static ATOMIC(unsigned int) sample_n(MEMTRACE_SAMPLE);
+
+	/* szalankenti visszaszamlalo, veletlen hosszal, hogy ne essen egybe a foglalasi mintakkal */
+	static THREAD_LOCAL unsigned int sample_countdown;
+	static THREAD_LOCAL unsigned int sample_rand;
+
+	/* a hivo szalban azonnal ervenyes, a tobbiben a folyamatban levo visszaszamlalas utan */
+	void set_sample_rate(unsigned int n) {
+		sample_n = n ? n : 1;
+		sample_countdown = 0;
+	}
+
+	unsigned int sample_rate() { return sample_n; }
+
+	static BOOL sample_next(void) {
+		unsigned int n;
+		if (sample_countdown > 1) {
+			sample_countdown--;
+			return FALSE;
+		}
+		n = sample_n;
+		if (n <= 1) {
+			sample_countdown = 0;
+			return TRUE;
+		}
+		/* xorshift32, a kezdoertek a szal egy valtozojanak cime */
+		if (sample_rand == 0) sample_rand = (unsigned int)(size_t)&sample_rand | 1;
+		sample_rand ^= sample_rand << 13;
+		sample_rand ^= sample_rand >> 17;
+		sample_rand ^= sample_rand << 5;
+		/* 1..2n-1, atlagosan n */
+		sample_countdown = 1 + sample_rand % (2*n - 1);
+		return TRUE;
+	}
+
+	/* a lapmeret also korlatja: ha a fejlec a blokkal egy lapon van, akkor olvashato */
+	static const size_t UNTRACKED_PAGE = 4096;
+
+	static BOOL header_on_page(const char * p) {
+		return (size_t)(p + UNTRACKED_LEN) % UNTRACKED_PAGE >= UNTRACKED_LEN ? TRUE : FALSE;
+	}
+
+	/* size+UNTRACKED_LEN bajtos blokk, aminek a fejlece egy lapon van a blokkal */
+	/* a rossz helyen levo blokkokat a keresesig lefoglalva tartja, hogy ne kapjuk vissza oket */
+	static char * untracked_block(size_t size, BOOL zero) {
+		char * bad = NULL;
+		char * p = (char*)(zero ? calloc(1, size+UNTRACKED_LEN) : malloc(size+UNTRACKED_LEN));
+		while (p != NULL && !header_on_page(p)) {
+			*(char**)p = bad;
+			bad = p;
+			p = (char*)(zero ? calloc(1, size+UNTRACKED_LEN) : malloc(size+UNTRACKED_LEN));
+		}
+		while (bad != NULL) {
+			char * next = *(char**)bad;
+			free(bad);
+			bad = next;
+		}
+		return p;
+	}
+
+	/* egy idegen pointer elott nem biztos, hogy olvashato memoria van: */
+	/* a kovetett blokkokat a nyilvantartasban talaljuk meg, a fejlecet csak a tobbinel, es csak a lapon belul olvassuk */
+	static BOOL is_untracked(void * pu) {
+		if (!header_on_page((char*)pu - UNTRACKED_LEN))
+			return FALSE;
+		{/*C-blokk*/
+			size_t s = shard_index(P(pu));
+			SHARD_LOCK(s);
+			if (find_registry_item(&registry[s], P(pu)) != NULL)
+				return FALSE;
+		}/*C-blokk*/
+		return UT_MAGIC(pu) == untracked_magic ? TRUE : FALSE;
+	}
+
+	static void * untracked_malloc(size_t size, BOOL zero) {
+		char * p = untracked_block(size, zero);
+		if (p == NULL) return NULL;
+		p += UNTRACKED_LEN;
+		UT_SIZE(p) = size;
+		UT_MAGIC(p) = untracked_magic;
+		allocated_blks++;
+		allocation_cnt++;
+		thread_allocation_cnt++;
+		live_bytes_cnt += size;
+		return p;
+	}
+
+	static void untracked_free(void * pu) {
+		allocated_blks--;
+		live_bytes_cnt -= UT_SIZE(pu);
+		UT_MAGIC(pu) = 0; /* ujabb felszabaditaskor mar a nyilvantartasban keressuk, es az hibat jelez */
+		free((char*)pu-UNTRACKED_LEN);
+	}
+
+	/* realloc helyett uj blokk es masolas, mert a realloc a fejlecet a lap elejere is teheti */
+	static void * untracked_realloc(void * pu, size_t size) {
+		char * p;
+		size_t oldsize = pu ? UT_SIZE(pu) : 0;
+		p = untracked_block(size, FALSE);
+		if (p == NULL) return NULL;
+		p += UNTRACKED_LEN;
+		if (pu == NULL) {
+			UT_MAGIC(p) = untracked_magic;
+			allocated_blks++;
+		} else {
+			memcpy(p, pu, oldsize < size ? oldsize : size);
+			UT_MAGIC(p) = untracked_magic;
+			UT_MAGIC(pu) = 0;
+			free((char*)pu-UNTRACKED_LEN);
+		}
+		allocation_cnt++;
+		thread_allocation_cnt++;
+		UT_SIZE(p) = size;
+		live_bytes_cnt += size;
+		live_bytes_cnt -= oldsize;
+		return p;
+	}
+END_NAMESPACE
+#endif/*MEMTRACE_SAMPLE*/
+
 /*******************************************************************/
 /* C-stílusú memóriakezelés */
 /*******************************************************************/
@@ -335,6 +1041,9 @@ START_NAMESPACE
 	void * traced_malloc(size_t size, const char * par_txt, int line, const char * file) {
 		void * p;
 		initialize();
+		#ifdef MEMTRACE_SAMPLE
+			if (!sample_next()) return untracked_malloc(size, FALSE);
+		#endif
 		p = canary_malloc(size, random_byte);
 		if (p) {
 			if(!register_memory(p,size,pack(FMALLOC,par_txt,line,file))) {
@@ -350,6 +1059,9 @@ START_NAMESPACE
 		void * p;
 		initialize();
                 size *= count;
+		#ifdef MEMTRACE_SAMPLE
+			if (!sample_next()) return untracked_malloc(size, TRUE);
+		#endif
                 p = canary_malloc(size, 0);
 		if(p) {
 			if(!register_memory(p,size,pack(FCALLOC,par_txt,line,file))) {
@@ -363,12 +1075,18 @@ START_NAMESPACE
 
 	void traced_free(void * pu, const char * par_txt, int line, const char * file) {
 		initialize();
+		#ifdef MEMTRACE_SAMPLE
+			if (pu && is_untracked(pu)) {
+				untracked_free(pu);
+				return;
+			}
+		#endif
 		if(pu) {
 			unregister_memory(P(pu), pack(FFREE,par_txt,line,file));
 			free(P(pu));
 		} else {
 			/*free(NULL) eset*/
-			#ifdef MEMTRACE_TO_FILE
+			#if defined(MEMTRACE_TO_FILE) && !defined(MEMTRACE_BINARY)
 				fprintf(trace_file,"%s\t%d\t%10s\t","NULL",-1,pretty[FFREE]);
 				fprintf(trace_file,"%d\t%s\n",line,file ? file : "?");
 				fflush(trace_file);
@@ -388,10 +1106,18 @@ START_NAMESPACE
         size_t oldsize = 0;
 		registry_item * n;
 		initialize();
+		#ifdef MEMTRACE_SAMPLE
+			/* a nem kovetett blokk nem kovetett marad, a kovetett kovetett */
+			if (old ? is_untracked(old) : !sample_next())
+				return untracked_realloc(old, size);
+		#endif
 
 		#ifdef MEMTRACE_TO_MEMORY
-        		n = find_registry_item(P(old));
-        		if (n) oldsize = n->next->size;
+        	{
+        		SHARD_LOCK(shard_index(P(old)));
+        		n = find_registry_item(&registry[shard_index(P(old))], P(old));
+        		if (n) oldsize = n->size;
+        	}
 			p = canary_malloc(size, random_byte);
         	#else
         		p = realloc(old, size);
@@ -433,8 +1159,9 @@ START_NAMESPACE
 		_new_handler = h;
 	}
 
-	static call_t delete_call;
-	static BOOL delete_called;
+	/* a delete makro es a delete operator kozotti adat szalankent kulon van */
+	static THREAD_LOCAL call_t delete_call;
+	static THREAD_LOCAL BOOL delete_called;
 
 	void set_delete_call(int line, const char * file) {
 		initialize();
@@ -445,6 +1172,16 @@ START_NAMESPACE
 	void * traced_new(size_t size, int line, const char * file, int func) {
 		initialize();
 		for (;;) {
+			#ifdef MEMTRACE_SAMPLE
+				if (!sample_next()) {
+					void * pu = untracked_malloc(size, FALSE);
+					if (pu) return pu;
+					if (_new_handler == 0)
+						throw std::bad_alloc();
+					_new_handler();
+					continue;
+				}
+			#endif
 			void * p = canary_malloc(size, random_byte);
 			if(p) {
 				register_memory(p,size,pack(func,"",line,file));
@@ -460,6 +1197,16 @@ START_NAMESPACE
 
 	void traced_delete(void * pu, int func) {
 		initialize();
+		#ifdef MEMTRACE_SAMPLE
+			if (pu && is_untracked(pu)) {
+				if (delete_called) {
+					if (delete_call.par_txt) free(delete_call.par_txt);
+					if (delete_call.file) free(delete_call.file);
+				}
+				untracked_free(pu);
+				pu = NULL;
+			}
+		#endif
 		if(pu) {
 			/*kiolvasom call-t, ha van*/
 			memtrace::call_t call = delete_called ? (delete_call.f=func, delete_call) : pack(func,NULL,0,NULL);
@@ -519,20 +1266,21 @@ void operator delete[](void * p, int, const char *) THROW_NOTHING {
 /*******************************************************************/
 
 START_NAMESPACE
-	static void initialize() {
-		static BOOL first = TRUE;
-		if(first) {
+	static void first_initialize() {
             fperror = stderr;
             random_byte = (unsigned char)time(NULL);
-			first = FALSE;
 			dying = FALSE;
 			#ifdef MEMTRACE_TO_MEMORY
-				registry.next = NULL;
 				#if !defined(USE_ATEXIT_OBJECT) && defined(MEMTRACE_AUTO)
 					atexit((void(*)(void))mem_check);
 				#endif
 			#endif
-			#ifdef MEMTRACE_TO_FILE
+			#ifdef MEMTRACE_PROFILE
+				atexit(profile_at_exit);
+			#endif
+			#if defined(MEMTRACE_BINARY)
+				trace_open();
+			#elif defined(MEMTRACE_TO_FILE)
 				trace_file = fopen("memtrace.dump","w");
 			#endif
 			#ifdef MEMTRACE_CPP
@@ -540,7 +1288,20 @@ START_NAMESPACE
 				delete_called = FALSE;
 				delete_call = pack(0,NULL,0,NULL);
 			#endif
+	}
+
+	static void initialize() {
+	#if defined(__cplusplus) && __cplusplus >= 201103L
+		/* a lokalis statikus valtozo inicializalasa szalbiztos, es csak egyszer tortenik meg */
+		static BOOL first = (first_initialize(), FALSE);
+		(void)first;
+	#else
+		static BOOL first = TRUE;
+		if(first) {
+			first = FALSE;
+			first_initialize();
 		}
+	#endif
 	}
 
 #if defined(MEMTRACE_TO_MEMORY) && defined(USE_ATEXIT_OBJECT)
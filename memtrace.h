@@ -16,13 +16,35 @@ inclue-ok:  2017., 2018., 2019., 2021., 2022.
 /*ha definiálva van, akkor a hibakat ebbe a fajlba írja, egyébkent stderr-re*/
 /*#define MEMTRACE_ERRFILE MEMTRACE.ERR*/
 
-/*ha definialva van, akkor futas kozben lancolt listat epit. Javasolt a hasznalata*/
+/*ha definialva van, akkor futas kozben nyilvantartja a foglalasokat (hash tabla). Javasolt a hasznalata*/
 #define MEMTRACE_TO_MEMORY
 
 /*ha definialva van, akkor futas kozben fajlba irja a foglalasokat*/
 /*ekkor nincs ellenorzes, csak naplozas*/
 /*#define MEMTRACE_TO_FILE*/
 
+/*ha definialva van, akkor MEMTRACE_TO_FILE eseten szoveg helyett binaris esemenyeket ir egy*/
+/*memoriaba lekepzett gyurube (memtrace.bin), ezt a tools/memtrace_decode dolgozza fel*/
+/*#define MEMTRACE_BINARY*/
+
+/*a gyuru merete esemenyekben (esemenyenkent 32 bajt), 2 hatvanya*/
+#ifndef MEMTRACE_BINARY_EVENTS
+	#define MEMTRACE_BINARY_EVENTS (1 << 20)
+#endif
+
+/*ha definialva van, akkor hivasi helyenkent osszesiti a foglalasokat (darab, bajt, csucs, elettartam)*/
+/*es kilepeskor kiirja a legtobb bajtot foglalo helyeket, MEMTRACE_TO_MEMORY kell hozza*/
+/*#define MEMTRACE_PROFILE*/
+
+/*ennyi helyet ir ki a profil riport kilepeskor*/
+#ifndef MEMTRACE_PROFILE_TOP
+	#define MEMTRACE_PROFILE_TOP 20
+#endif
+
+/*ha definialva van, akkor atlagosan csak minden N-edik foglalast koveti teljesen (kanari, nyilvantartas),*/
+/*a tobbi csak a foglalt blokkok es bajtok szamlalojat noveli, MEMTRACE_TO_MEMORY kell hozza*/
+/*#define MEMTRACE_SAMPLE 64*/
+
 /*ha definialva van, akkor a megallaskor automatikus riport keszul */
 #define MEMTRACE_AUTO
 
@@ -60,6 +82,15 @@ inclue-ok:  2017., 2018., 2019., 2021., 2022.
     #undef USE_ATEXIT_OBJECT
 #endif
 
+#ifndef MEMTRACE_TO_FILE
+	#undef MEMTRACE_BINARY
+#endif
+
+#ifndef MEMTRACE_TO_MEMORY
+	#undef MEMTRACE_PROFILE
+	#undef MEMTRACE_SAMPLE
+#endif
+
 #ifdef __cplusplus
 	#define START_NAMESPACE namespace memtrace {
 	#define END_NAMESPACE } /*namespace*/
@@ -97,12 +128,36 @@ inclue-ok:  2017., 2018., 2019., 2021., 2022.
 
 START_NAMESPACE
 	int allocated_blocks();
+	/* az indulas ota tortent foglalasok szama, a felszabaditasok nem csokkentik */
+	unsigned long allocation_count();
+	/* ugyanez csak a hivo szal foglalasaibol */
+	unsigned long thread_allocation_count();
 END_NAMESPACE
 
 #if defined(MEMTRACE_TO_MEMORY)
 START_NAMESPACE
     int mem_check(void);
     int poi_check(void*);
+    /* az elo blokkok osszmerete, a mintavetelezesbol kimaradtakkal egyutt */
+    size_t live_bytes();
+END_NAMESPACE
+#endif
+
+#if defined(MEMTRACE_SAMPLE)
+START_NAMESPACE
+	/* atlagosan minden n-edik foglalas lesz kovetve, 1 eseten mindegyik */
+	void set_sample_rate(unsigned int n);
+	unsigned int sample_rate();
+END_NAMESPACE
+#endif
+
+#if defined(MEMTRACE_PROFILE)
+#include <stdio.h>
+START_NAMESPACE
+	/* a legtobb bajtot foglalo top hivasi helyet irja ki fp-be (NULL eseten stderr-re) */
+	void profile_report(unsigned int top = MEMTRACE_PROFILE_TOP, FILE * fp = NULL);
+	/* nullazza a hivasi helyek szamlaloit */
+	void profile_reset(void);
 END_NAMESPACE
 #endif
 
@@ -162,6 +217,14 @@ END_NAMESPACE
 	#include <stdexcept>
 	#include <ctime>
 	#include <random>
+	#include <utility>
+	#include <deque>
+	#if __cplusplus >= 201103L
+		#include <atomic>
+		#include <mutex>
+		#include <condition_variable>
+		#include <thread>
+	#endif
     #if __cplusplus >= 201103L
         #include <iterator>
         #include <regex>
@@ -0,0 +1,57 @@
+/*********************************
+Memtrace binaris nyomkoveto fajl (memtrace.bin) formatuma
+MEMTRACE_TO_FILE es MEMTRACE_BINARY eseten ezt irja a memtrace,
+a tools/memtrace_decode ezt olvassa.
+
+Felepites:
+  fejlec | esemenyek gyuruje | helytabla | string tabla
+A gyuru tele eseten korbeer, ekkor csak az utolso `events` esemeny marad meg.
+*********************************/
+
+#ifndef MEMTRACE_TRACE_H
+#define MEMTRACE_TRACE_H
+
+#include <stdint.h>
+
+#define MEMTRACE_TRACE_MAGIC "MTRACE01"
+
+/* ismeretlen hely, vagy megtelt a helytabla */
+#define MEMTRACE_TRACE_NO_SITE 0xffffffffu
+/* ismeretlen fajlnev */
+#define MEMTRACE_TRACE_NO_FILE 0xffffffffu
+
+/* az esemeny fajtaja */
+#define MEMTRACE_TRACE_ALLOC 0
+#define MEMTRACE_TRACE_FREE 1
+
+typedef struct {
+	char magic[8];            /* MEMTRACE_TRACE_MAGIC */
+	uint32_t event_size;      /* sizeof(memtrace_event) */
+	uint32_t site_size;       /* sizeof(memtrace_site) */
+	uint64_t events;          /* a gyuru merete, 2 hatvanya */
+	uint64_t sites;           /* a helytabla merete */
+	uint64_t strings;         /* a string tabla merete bajtban */
+	uint64_t head;            /* az eddig irt esemenyek szama, a kovetkezo a head % events helyre kerul */
+	uint64_t site_count;      /* a hasznalt helyek szama */
+	uint64_t strings_used;    /* a hasznalt bajtok szama a string tablaban */
+	uint64_t events_offset;   /* a reszek kezdete a fajl elejehez kepest */
+	uint64_t sites_offset;
+	uint64_t strings_offset;
+} memtrace_trace_header;
+
+typedef struct {
+	uint64_t time;    /* ns a nyomkovetes kezdete ota */
+	uint64_t ptr;     /* a felhasznaloi pointer */
+	uint64_t size;    /* foglalaskor a blokk merete, felszabaditaskor 0 */
+	uint32_t site;    /* index a helytablaba, vagy MEMTRACE_TRACE_NO_SITE */
+	uint8_t kind;     /* MEMTRACE_TRACE_ALLOC vagy MEMTRACE_TRACE_FREE */
+	uint8_t op;       /* 0 malloc, 1 calloc, 2 realloc, 3 free, 4 new, 5 delete, 6 new[], 7 delete[] */
+	uint16_t thread;  /* a szal sorszama, az elso esemenyenek sorrendjeben */
+} memtrace_event;
+
+typedef struct {
+	uint32_t file;    /* a fajlnev kezdete a string tablaban, vagy MEMTRACE_TRACE_NO_FILE */
+	uint32_t line;
+} memtrace_site;
+
+#endif /*MEMTRACE_TRACE_H*/
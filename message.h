@@ -6,36 +6,71 @@
 #include <cstring>
 #include <string>
 #include "bigint.h"
+#include "rsa_key.h"
+#include "thread_pool.h"
 #include "memtrace.h"
 
-// use this macro to display additional information about the primes, decryption key, etc...
-//#define DEBUG
-
 /**
- * Defines the bit-width of the bigints stored in the message, the key_size of the rsa algorithm
- * and the primes used for the key creation.
+ * Controls how the blocks of a message are split between the threads of a ThreadPool.
  */
-enum message_size
+enum parallel_size
 {
-    // bigint_size has to be twice the size of key_size as we need to account for multiplication inside the algorithms
-    bigint_size = 256,
-    // key_size has to be twice the size of the primes as this is created through their multiplication
-    key_size = 128,
-    // we use the value of prime_size to determine the values of the above two
-    prime_size = 64,
-    // c_size can always stay 32 bits, it just has to be smaller than the primes
-    c_size = 32,
+    // messages with fewer blocks than this are processed on the calling thread
+    parallel_threshold = 256,
+    // the smallest number of consecutive blocks handed to a thread at once, whole batches of batch_lanes blocks
+    min_chunk_size = 8 * batch_lanes,
 };
+static_assert(min_chunk_size % batch_lanes == 0, "min_chunk_size has to be a multiple of batch_lanes");
 
 class Message
 {
     std::vector<Bigint<bigint_size> > message;
-    Bigint<bigint_size> primes[2];
-    Bigint<bigint_size> c;
-    Bigint<bigint_size> public_key;
-    Bigint<bigint_size> private_key;
     bool is_encrypted;
 
+    // every thread gets about 4 chunks so the work can be balanced by stealing,
+    // the chunks are whole batches so only the last one can leave lanes empty
+    size_t chunk_size(const ThreadPool &pool) const
+    {
+        size_t chunk = message.size() / (pool.size() * 4);
+        if (chunk < min_chunk_size)
+            return min_chunk_size;
+        return (chunk + batch_lanes - 1) / batch_lanes * batch_lanes;
+    }
+
+    /**
+     * Encrypts the blocks in [begin, end) batch_lanes at a time, the lanes after the last block are left 0.
+     */
+    void encrypt_range(const PublicKey &key, const size_t &begin, const size_t &end)
+    {
+        for (size_t i = begin; i < end; i += batch_lanes)
+        {
+            BigintBatch<bigint_size, batch_lanes> batch;
+            unsigned int count = end - i < batch_lanes ? end - i : batch_lanes;
+            for (unsigned int l = 0; l < count; ++l)
+                batch.set(l, message[i + l]);
+            batch = key.encrypt(batch);
+            for (unsigned int l = 0; l < count; ++l)
+                message[i + l] = batch.get(l);
+        }
+    }
+
+    /**
+     * Decrypts the blocks in [begin, end) batch_lanes at a time, the lanes after the last block are left 0.
+     */
+    void decrypt_range(const PrivateKey &key, const size_t &begin, const size_t &end)
+    {
+        for (size_t i = begin; i < end; i += batch_lanes)
+        {
+            BigintBatch<bigint_size, batch_lanes> batch;
+            unsigned int count = end - i < batch_lanes ? end - i : batch_lanes;
+            for (unsigned int l = 0; l < count; ++l)
+                batch.set(l, message[i + l]);
+            batch = key.decrypt(batch);
+            for (unsigned int l = 0; l < count; ++l)
+                message[i + l] = batch.get(l);
+        }
+    }
+
 public:
     Message() : is_encrypted(false) {}
 
@@ -51,26 +86,6 @@ public:
         std::copy(string.begin(), string.end(), message.begin());
     }
 
-    Message(const Message &x) : message(x.message), c(x.c), public_key(x.public_key), private_key(x.private_key), is_encrypted(x.is_encrypted)
-    {
-        primes[0] = x.primes[0];
-        primes[1] = x.primes[1];
-    }
-    Message &operator=(const Message &x)
-    {
-        if (this != &x)
-        {
-            message = x.message;
-            primes[0] = x.primes[0];
-            primes[1] = x.primes[1];
-            c = x.c;
-            public_key = x.public_key;
-            private_key = x.private_key;
-            is_encrypted = x.is_encrypted;
-        }
-        return *this;
-    }
-
     /**
      * @param index the position of the character
      * @return the character at the index, it's not a reference as this
@@ -118,60 +133,57 @@ public:
         return message == x.message;
     }
 
-    void encrypt()
+    /**
+     * Encrypts every block of the message, the key is not stored in the message.
+     * @param key the public part of an RsaKeyPair
+     */
+    void encrypt(const PublicKey &key)
     {
-        // generate the 2 primes for the algorithm
-        for (unsigned short i = 0; i < 2; ++i)
-        {
-            // we generate a new number until we find a prime
-            Bigint<bigint_size> my_prime;
-            do
-            {
-                my_prime.rng(prime_size);
-            } while (!my_prime.prime_check());
-#ifdef DEBUG
-            std::cout << "prime found: " << my_prime << std::endl;
-#endif
-            primes[i] = my_prime;
-        }
-        // the public key will be the product of the primes
-        public_key = primes[0] * primes[1];
-        Bigint<bigint_size> null;
-        Bigint<bigint_size> one(1);
-        // find a c such that c and the public_key are coprimes
-        do
-        {
-            c.rng(c_size);
-        } while (!c.prime_check() || public_key.gcd(c) != one);
-#ifdef DEBUG
-        std::cout << "c: " << c << std::endl;
-        std::cout << "public key: " << public_key << std::endl;
-#endif
+        if (is_encrypted)
+            throw(std::logic_error("Message is already encrypted"));
         // execute the encryption function on the entire message
-        for (std::vector<Bigint<bigint_size> >::iterator i = message.begin(); i < message.end();)
-            *i++ = (*i).exponentiation(c, public_key);
+        encrypt_range(key, 0, message.size());
         is_encrypted = true;
     }
-    void decrypt()
+    /**
+     * Decrypts every block of the message.
+     * @param key the private part of the RsaKeyPair used for the encryption
+     */
+    void decrypt(const PrivateKey &key)
     {
-        // calculate the private_key, this is the Carmichael's totient function
-        // here the 2 inputs are the primes - 1 (the result of Euler's function, how many coprimes a given number has below them)
-        // then we have to calculate the lcm of the primes - 1
-        // we can do this as |a*b|/gcd(a,b)
-        Bigint<bigint_size> one(1);
-        Bigint<bigint_size> temp1(primes[0] - one);
-        Bigint<bigint_size> temp2(primes[1] - one);
-        private_key = (temp1 * temp2) / temp1.gcd(temp2);
-        // determine the decryption key by getting the modular multiplicative inverse of c
-        Bigint<bigint_size> decryption_key = c.inverse(private_key);
-#ifdef DEBUG
-        std::cout << "gcd: " << temp1.gcd(temp2) << std::endl;
-        std::cout << "private_key: " << private_key << std::endl;
-        std::cout << "decryption key: " << decryption_key << std::endl;
-#endif
-        // after finding the decryption key we just have to execute the decryption function
-        for (std::vector<Bigint<bigint_size> >::iterator i = message.begin(); i < message.end();)
-            *i++ = (*i).exponentiation(decryption_key, public_key);
+        if (!is_encrypted)
+            throw(std::logic_error("Message is not encrypted"));
+        decrypt_range(key, 0, message.size());
+        is_encrypted = false;
+    }
+    /**
+     * Encrypts the blocks of the message in parallel, small messages are encrypted on the calling thread.
+     * @param key the public part of an RsaKeyPair
+     * @param pool the threads used for the encryption
+     */
+    void encrypt(const PublicKey &key, ThreadPool &pool)
+    {
+        if (is_encrypted)
+            throw(std::logic_error("Message is already encrypted"));
+        if (message.size() < parallel_threshold || pool.size() < 2)
+            return encrypt(key);
+        pool.parallel_for(message.size(), chunk_size(pool), [this, &key](size_t begin, size_t end)
+                          { encrypt_range(key, begin, end); });
+        is_encrypted = true;
+    }
+    /**
+     * Decrypts the blocks of the message in parallel, small messages are decrypted on the calling thread.
+     * @param key the private part of the RsaKeyPair used for the encryption
+     * @param pool the threads used for the decryption
+     */
+    void decrypt(const PrivateKey &key, ThreadPool &pool)
+    {
+        if (!is_encrypted)
+            throw(std::logic_error("Message is not encrypted"));
+        if (message.size() < parallel_threshold || pool.size() < 2)
+            return decrypt(key);
+        pool.parallel_for(message.size(), chunk_size(pool), [this, &key](size_t begin, size_t end)
+                          { decrypt_range(key, begin, end); });
         is_encrypted = false;
     }
     friend std::ostream &operator<<(std::ostream &, Message &);
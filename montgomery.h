@@ -0,0 +1,300 @@
+#ifndef MONTGOMERY_H
+#define MONTGOMERY_H
+
+#include <stdexcept>
+#include <utility>
+#include "bigint.h"
+#include "montgomery_kernels.h"
+#include "memtrace.h"
+
+/**
+ * Compile-time left-to-right binary addition chain for a constant exponent.
+ * Every step squares the accumulator, steps[i] tells whether it's followed by a multiplication with the base.
+ * @tparam exponent has to be greater than 0
+ */
+template <unsigned long long exponent>
+struct AdditionChain
+{
+    static_assert(exponent > 0, "the exponent of an addition chain has to be greater than 0");
+    static constexpr unsigned int bit_count()
+    {
+        unsigned int n = 0;
+        for (unsigned long long e = exponent; e != 0; e >>= 1)
+            ++n;
+        return n;
+    }
+    // the top bit is the starting value of the accumulator, the rest of the bits are the steps
+    static constexpr unsigned int length = bit_count() - 1;
+    struct step_table
+    {
+        // one extra element so the array is never empty
+        bool multiply[length + 1];
+    };
+    static constexpr step_table generate()
+    {
+        step_table res{};
+        for (unsigned int i = 0; i < length; ++i)
+            res.multiply[i] = (exponent >> (length - 1 - i)) & 1;
+        return res;
+    }
+    static constexpr step_table steps = generate();
+};
+
+/**
+ * Precomputed values for Montgomery multiplication modulo a fixed odd modulus.
+ * Numbers are kept in the Montgomery domain (x * R mod m, where R = 2^(32 * limbs) for the scalar kernel
+ * and 2^(digit bits * digits) for the others), so every modular multiplication only needs
+ * word-level reductions instead of a division.
+ * @tparam bits number of bits used to store the integers, the modulus has to fit into bits - 1.
+ */
+template <unsigned int bits>
+struct MontgomeryContext
+{
+    Bigint<bits> modulus;
+    // -modulus^(-1) mod 2^32
+    unsigned int m_prime;
+    // number of array elements needed to store the modulus
+    unsigned int limbs;
+    // R mod modulus, this is 1 in the Montgomery domain
+    Bigint<bits> r;
+    // R^2 mod modulus, used for converting into the Montgomery domain
+    Bigint<bits> r2;
+    // the kernel set used by multiply, it's chosen when the context is built
+    kernel_set kernels;
+    // number of digits of the modulus in the radix of the kernel, and the same rounded up to whole vectors
+    unsigned int digits;
+    unsigned int padded_digits;
+    // the modulus in the radix of the kernel, and -modulus^(-1) mod 2^(digit bits)
+    unsigned long long modulus_digits[bits / 29 + 8];
+    unsigned long long digit_m_prime;
+    // the best kernel set of the CPU for the size of the modulus
+    MontgomeryContext(const Bigint<bits> &);
+    // the given kernel set, or the default one if the CPU doesn't support it
+    MontgomeryContext(const Bigint<bits> &, const kernel_set &);
+    // Montgomery product: a * b * R^(-1) mod modulus
+    Bigint<bits> multiply(const Bigint<bits> &, const Bigint<bits> &) const;
+    Bigint<bits> to_montgomery(const Bigint<bits> &) const;
+    Bigint<bits> from_montgomery(const Bigint<bits> &) const;
+    // modular exponentiation with the precomputed modulus
+    Bigint<bits> exponentiation(const Bigint<bits> &, const Bigint<bits> &) const;
+    // modular exponentiation with a constant exponent, the steps are unrolled at compile time
+    template <unsigned long long exponent>
+    Bigint<bits> exponentiation(const Bigint<bits> &) const;
+
+private:
+    static constexpr unsigned int max_digits = bits / 29 + 8;
+    Bigint<bits> multiply_kernel(const Bigint<bits> &, const Bigint<bits> &) const;
+    template <bool multiply_base>
+    void chain_step(Bigint<bits> &, const Bigint<bits> &) const;
+    template <unsigned long long exponent, std::size_t... i>
+    void run_chain(Bigint<bits> &, const Bigint<bits> &, std::index_sequence<i...>) const;
+};
+
+/**
+ * @param m the modulus, it has to be odd.
+ */
+template <unsigned int bits>
+MontgomeryContext<bits>::MontgomeryContext(const Bigint<bits> &m) : MontgomeryContext(m, montgomery_kernels::select(m.num_bits()))
+{
+}
+
+/**
+ * @param m the modulus, it has to be odd.
+ * @param k the kernel set to use, if the CPU doesn't support it, it's replaced by the default one
+ */
+template <unsigned int bits>
+MontgomeryContext<bits>::MontgomeryContext(const Bigint<bits> &m, const kernel_set &k) : modulus(m), kernels(k), digits(0), padded_digits(0), digit_m_prime(0)
+{
+    if (m.is_even())
+        throw std::domain_error("Montgomery modulus has to be odd");
+    if (!montgomery_kernels::supported(kernels))
+        kernels = montgomery_kernels::select(m.num_bits());
+    limbs = (m.num_bits() + sizeof(unsigned int) * 8 - 1) / (sizeof(unsigned int) * 8);
+    unsigned int r_bits = limbs * sizeof(unsigned int) * 8;
+    if (kernels != scalar_kernels)
+    {
+        unsigned int digit_bits = montgomery_kernels::digit_bits(kernels);
+        unsigned int lanes = montgomery_kernels::lanes(kernels);
+        digits = (m.num_bits() + digit_bits - 1) / digit_bits;
+        padded_digits = (digits + lanes - 1) / lanes * lanes;
+        montgomery_kernels::split(m.storage, limbs, modulus_digits, padded_digits, digit_bits);
+        digit_m_prime = montgomery_kernels::digit_inverse((unsigned long long)m.storage[0] | (limbs > 1 ? (unsigned long long)m.storage[1] << 32 : 0), digit_bits);
+        r_bits = digits * digit_bits;
+    }
+    // Newton iteration for the inverse of the lowest array element, every step doubles the correct bits
+    unsigned int inv = m.storage[0];
+    for (unsigned short i = 0; i < 4; ++i)
+        inv *= 2 - m.storage[0] * inv;
+    m_prime = 0U - inv;
+    // R mod m and R^2 mod m are calculated with doubling and conditional subtraction
+    unsigned int ms_part = bits / (sizeof(unsigned int) * 8) - 1;
+    unsigned int bitsize_m_1 = (sizeof(unsigned int) * 8) - 1;
+    Bigint<bits> x(1);
+    for (unsigned int i = 0; i < 2 * r_bits; ++i)
+    {
+        // the bit shifted out of the storage has to be taken into account
+        unsigned int carry = x.storage[ms_part] >> bitsize_m_1;
+        x = x << 1;
+        if (carry != 0 || !(x < modulus))
+            x = x - modulus;
+        if (i + 1 == r_bits)
+            r = x;
+    }
+    r2 = x;
+}
+
+/**
+ * Coarsely integrated operand scanning (CIOS) Montgomery multiplication.
+ * @param a must be less than the modulus
+ * @param b must be less than the modulus
+ * @return a * b * R^(-1) mod modulus
+ */
+template <unsigned int bits>
+Bigint<bits> MontgomeryContext<bits>::multiply(const Bigint<bits> &a, const Bigint<bits> &b) const
+{
+    BIGINT_COUNT(op_montgomery_multiply, bits);
+    if (kernels != scalar_kernels)
+        return multiply_kernel(a, b);
+    // the running sum needs 2 more array elements than the modulus
+    unsigned int t[bits / (sizeof(unsigned int) * 8) + 2] = {0};
+    unsigned long long carry;
+    unsigned long long temp;
+    for (unsigned int i = 0; i < limbs; ++i)
+    {
+        // t += a * b[i]
+        carry = 0;
+        for (unsigned int j = 0; j < limbs; ++j)
+        {
+            temp = (unsigned long long)t[j] + (unsigned long long)a.storage[j] * (unsigned long long)b.storage[i] + carry;
+            t[j] = (unsigned int)temp;
+            carry = temp >> (8 * sizeof(unsigned int));
+        }
+        temp = (unsigned long long)t[limbs] + carry;
+        t[limbs] = (unsigned int)temp;
+        t[limbs + 1] = temp >> (8 * sizeof(unsigned int));
+        // t = (t + m * modulus) / 2^32, m is chosen so that the lowest element becomes zero
+        unsigned int m = t[0] * m_prime;
+        temp = (unsigned long long)t[0] + (unsigned long long)m * (unsigned long long)modulus.storage[0];
+        carry = temp >> (8 * sizeof(unsigned int));
+        for (unsigned int j = 1; j < limbs; ++j)
+        {
+            temp = (unsigned long long)t[j] + (unsigned long long)m * (unsigned long long)modulus.storage[j] + carry;
+            t[j - 1] = (unsigned int)temp;
+            carry = temp >> (8 * sizeof(unsigned int));
+        }
+        temp = (unsigned long long)t[limbs] + carry;
+        t[limbs - 1] = (unsigned int)temp;
+        t[limbs] = t[limbs + 1] + (unsigned int)(temp >> (8 * sizeof(unsigned int)));
+    }
+    // the result is less than 2 * modulus, a single subtraction brings it into range
+    Bigint<bits> res;
+    unsigned int n = bits / (sizeof(unsigned int) * 8);
+    for (unsigned int i = 0; i <= limbs && i < n; ++i)
+        res.storage[i] = t[i];
+    if (t[limbs] != 0 || !(res < modulus))
+        res = res - modulus;
+    return res;
+}
+
+/**
+ * Montgomery multiplication with one of the x86 kernels, the operands are split into digits for each call.
+ * @param a must be less than the modulus
+ * @param b must be less than the modulus
+ * @return a * b * R^(-1) mod modulus
+ */
+template <unsigned int bits>
+Bigint<bits> MontgomeryContext<bits>::multiply_kernel(const Bigint<bits> &a, const Bigint<bits> &b) const
+{
+    unsigned int digit_bits = montgomery_kernels::digit_bits(kernels);
+    unsigned long long da[max_digits];
+    unsigned long long db[max_digits];
+    unsigned long long t[2 * max_digits + 2];
+    montgomery_kernels::split(a.storage, limbs, da, padded_digits, digit_bits);
+    montgomery_kernels::split(b.storage, limbs, db, padded_digits, digit_bits);
+    std::memset(t, 0, (2 * padded_digits + 2) * sizeof(unsigned long long));
+#ifdef MONTGOMERY_X86_KERNELS
+    if (kernels == adx_kernels)
+        montgomery_kernels::multiply_adx(t, da, db, modulus_digits, digit_m_prime, digits);
+    else if (kernels == avx512ifma_kernels)
+        montgomery_kernels::multiply_avx512ifma(t, da, db, modulus_digits, digit_m_prime, digits, padded_digits);
+    else
+        montgomery_kernels::multiply_avx2(t, da, db, modulus_digits, digit_m_prime, digits, padded_digits);
+#endif
+    // the result is less than 2 * modulus, a single subtraction brings it into range;
+    // with a full width modulus it may not fit into bits, the subtraction wraps around then
+    Bigint<bits> res;
+    bool overflow = montgomery_kernels::join(t + digits, padded_digits + 1, res.storage, bits / (sizeof(unsigned int) * 8), digit_bits);
+    if (overflow || !(res < modulus))
+        res = res - modulus;
+    return res;
+}
+
+template <unsigned int bits>
+Bigint<bits> MontgomeryContext<bits>::to_montgomery(const Bigint<bits> &x) const
+{
+    return multiply(x, r2);
+}
+
+template <unsigned int bits>
+Bigint<bits> MontgomeryContext<bits>::from_montgomery(const Bigint<bits> &x) const
+{
+    return multiply(x, Bigint<bits>(1));
+}
+
+/**
+ * Left-to-right square and multiply exponentiation in the Montgomery domain.
+ * @param a the base, it's reduced first if it's not less than the modulus
+ * @param b the exponent
+ * @return aˆb % modulus
+ */
+template <unsigned int bits>
+Bigint<bits> MontgomeryContext<bits>::exponentiation(const Bigint<bits> &a, const Bigint<bits> &b) const
+{
+    Bigint<bits> base = to_montgomery(a < modulus ? a : a % modulus);
+    Bigint<bits> c(r);
+    for (int i = b.num_bits() - 1; i >= 0; --i)
+    {
+        c = multiply(c, c);
+        if ((b.storage[i / (sizeof(unsigned int) * 8)] >> (i % (sizeof(unsigned int) * 8))) & 1)
+            c = multiply(c, base);
+    }
+    return from_montgomery(c);
+}
+
+/**
+ * One step of an addition chain: a squaring optionally followed by a multiplication with the base.
+ */
+template <unsigned int bits>
+template <bool multiply_base>
+void MontgomeryContext<bits>::chain_step(Bigint<bits> &c, const Bigint<bits> &base) const
+{
+    c = multiply(c, c);
+    if constexpr (multiply_base)
+        c = multiply(c, base);
+}
+
+template <unsigned int bits>
+template <unsigned long long exponent, std::size_t... i>
+void MontgomeryContext<bits>::run_chain(Bigint<bits> &c, const Bigint<bits> &base, std::index_sequence<i...>) const
+{
+    (chain_step<AdditionChain<exponent>::steps.multiply[i]>(c, base), ...);
+}
+
+/**
+ * Modular exponentiation with an exponent known at compile time,
+ * e.g. for 65537 it's 16 squarings and a single multiplication without any loop.
+ * @tparam exponent has to be greater than 0
+ * @param a the base, it's reduced first if it's not less than the modulus
+ * @return aˆexponent % modulus
+ */
+template <unsigned int bits>
+template <unsigned long long exponent>
+Bigint<bits> MontgomeryContext<bits>::exponentiation(const Bigint<bits> &a) const
+{
+    Bigint<bits> base = to_montgomery(a < modulus ? a : a % modulus);
+    Bigint<bits> c(base);
+    run_chain<exponent>(c, base, std::make_index_sequence<AdditionChain<exponent>::length>());
+    return from_montgomery(c);
+}
+
+#endif
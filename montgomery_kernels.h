@@ -0,0 +1,357 @@
+#ifndef MONTGOMERY_KERNELS_H
+#define MONTGOMERY_KERNELS_H
+
+#include <cstdlib>
+#include <cstring>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define MONTGOMERY_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+/**
+ * The implementations of the Montgomery product, ordered by the instruction set they need.
+ * The vector kernels keep the numbers in reduced-radix digits, one digit in each 64 bit lane,
+ * so the partial products of a row can be added up without carry propagation.
+ */
+enum kernel_set
+{
+    // portable CIOS on 32 bit array elements
+    scalar_kernels,
+    // CIOS on 64 bit words with mulx and two independent carry chains (adcx, adox),
+    // only for the Montgomery product: operator+ has a single carry chain and operator* isn't on the modexp path
+    adx_kernels,
+    // radix 2^29, 4 lanes of 32 x 32 -> 64 bit products (vpmuludq)
+    avx2_kernels,
+    // radix 2^52, 8 lanes of 52 x 52 -> 104 bit products (vpmadd52luq, vpmadd52huq)
+    avx512ifma_kernels,
+};
+
+/**
+ * The kernels only pay off once the conversion into digits is small compared to the products,
+ * below these modulus sizes (in bits) they aren't selected. Measured on an AVX-512 IFMA machine:
+ * adx is ahead of scalar from 256 bits and ahead of avx2 at every size, avx2 is ahead of scalar
+ * from 512 bits, avx512ifma is ahead of adx from 1024 bits.
+ */
+enum kernel_threshold
+{
+    adx_threshold = 256,
+    avx2_threshold = 512,
+    avx512ifma_threshold = 1024,
+};
+
+namespace montgomery_kernels
+{
+    /**
+     * @return the name of the kernel set as accepted by the BIGINT_KERNELS environment variable
+     */
+    inline const char *name(const kernel_set &k)
+    {
+        static const char *const names[] = {"scalar", "adx", "avx2", "avx512ifma"};
+        return names[k];
+    }
+
+    /**
+     * Checks the CPU with cpuid once at startup, a CPU may have avx2 without adx, so every set is checked on its own.
+     * The BIGINT_KERNELS environment variable (scalar, adx, avx2 or avx512ifma) disables the sets after the given one.
+     * @return true if the kernel set can be used on this CPU
+     */
+    inline bool supported(const kernel_set &k)
+    {
+        static const unsigned int supported_sets = []() {
+            unsigned int res = 1U << scalar_kernels;
+#ifdef MONTGOMERY_X86_KERNELS
+            __builtin_cpu_init();
+            if (__builtin_cpu_supports("bmi2") && __builtin_cpu_supports("adx"))
+                res |= 1U << adx_kernels;
+            if (__builtin_cpu_supports("avx2"))
+                res |= 1U << avx2_kernels;
+            if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512ifma"))
+                res |= 1U << avx512ifma_kernels;
+#endif
+            const char *env = std::getenv("BIGINT_KERNELS");
+            if (env != nullptr)
+                for (int k = scalar_kernels; k <= avx512ifma_kernels; ++k)
+                    if (std::strcmp(env, name((kernel_set)k)) == 0)
+                        res &= (2U << k) - 1;
+            return res;
+        }();
+        return (supported_sets >> k) & 1;
+    }
+
+    /**
+     * The lane kernels of BigintBatch only need AVX-512F, a CPU may have it without IFMA.
+     * BIGINT_KERNELS disables it like avx512ifma_kernels.
+     * @return true if the AVX-512 lane kernel can be used on this CPU
+     */
+    inline bool supported_avx512f()
+    {
+        static const bool cpu = []() {
+#ifdef MONTGOMERY_X86_KERNELS
+            __builtin_cpu_init();
+            return (bool)__builtin_cpu_supports("avx512f");
+#else
+            return false;
+#endif
+        }();
+        if (!cpu)
+            return false;
+        const char *env = std::getenv("BIGINT_KERNELS");
+        if (env == nullptr)
+            return true;
+        for (int k = scalar_kernels; k < avx512ifma_kernels; ++k)
+            if (std::strcmp(env, name((kernel_set)k)) == 0)
+                return false;
+        return true;
+    }
+
+    /**
+     * @return the last kernel set this CPU supports
+     */
+    inline kernel_set detected()
+    {
+        int k = avx512ifma_kernels;
+        while (!supported((kernel_set)k))
+            --k;
+        return (kernel_set)k;
+    }
+
+    /**
+     * The order isn't the order of the kernel sets: adx beats avx2, so avx2 is only used without adx.
+     * @param modulus_bits the number of bits of the modulus
+     * @return the kernel set used by default for a modulus of this size
+     */
+    inline kernel_set select(const unsigned int &modulus_bits)
+    {
+        if (supported(avx512ifma_kernels) && modulus_bits >= avx512ifma_threshold)
+            return avx512ifma_kernels;
+        if (supported(adx_kernels) && modulus_bits >= adx_threshold)
+            return adx_kernels;
+        if (supported(avx2_kernels) && modulus_bits >= avx2_threshold)
+            return avx2_kernels;
+        return scalar_kernels;
+    }
+
+    /**
+     * @return the number of bits in a digit of the kernel set, 32 for the scalar one
+     */
+    inline unsigned int digit_bits(const kernel_set &k)
+    {
+        return k == avx512ifma_kernels ? 52 : k == avx2_kernels ? 29 : k == adx_kernels ? 64 : 32;
+    }
+
+    /**
+     * @return the number of digits processed by one vector instruction
+     */
+    inline unsigned int lanes(const kernel_set &k)
+    {
+        return k == avx512ifma_kernels ? 8 : k == avx2_kernels ? 4 : 1;
+    }
+
+    /**
+     * Splits a number into digit_bits wide digits.
+     * @param x limbs array elements
+     * @param d count digits, the ones above the number are zeroed
+     */
+    inline void split(const unsigned int *x, const unsigned int &limbs, unsigned long long *d, const unsigned int &count, const unsigned int &digit_bits)
+    {
+        const unsigned long long mask = digit_bits < 64 ? (1ULL << digit_bits) - 1 : ~0ULL;
+        for (unsigned int i = 0; i < count; ++i)
+        {
+            // a digit is spread over at most 3 array elements
+            unsigned int pos = i * digit_bits / (sizeof(unsigned int) * 8);
+            unsigned int shift = i * digit_bits % (sizeof(unsigned int) * 8);
+            unsigned long long lo = pos < limbs ? x[pos] : 0;
+            unsigned long long mid = pos + 1 < limbs ? x[pos + 1] : 0;
+            unsigned long long hi = pos + 2 < limbs ? x[pos + 2] : 0;
+            unsigned long long v = (lo | mid << (sizeof(unsigned int) * 8)) >> shift;
+            if (shift != 0)
+                v |= hi << (64 - shift);
+            d[i] = v & mask;
+        }
+    }
+
+    /**
+     * Propagates the carries of unnormalized digits and joins them into 32 bit array elements.
+     * @param d count digits, they are normalized in place, 64 bit digits are always normalized
+     * @param x limbs array elements, the bits above them are dropped
+     * @return true if a nonzero bit was dropped, e.g. a Montgomery result between 2^bits and 2 * m
+     */
+    inline bool join(unsigned long long *d, const unsigned int &count, unsigned int *x, const unsigned int &limbs, const unsigned int &digit_bits)
+    {
+        unsigned long long carry = 0;
+        for (unsigned int i = 0; i < count && digit_bits < 64; ++i)
+        {
+            d[i] += carry;
+            carry = d[i] >> digit_bits;
+            d[i] &= (1ULL << digit_bits) - 1;
+        }
+        bool dropped = carry != 0;
+        const unsigned int total_bits = limbs * sizeof(unsigned int) * 8;
+        std::memset(x, 0, limbs * sizeof(unsigned int));
+        for (unsigned int i = 0; i < count; ++i)
+        {
+            if (i * digit_bits >= total_bits)
+                dropped |= d[i] != 0;
+            else if (total_bits - i * digit_bits < 64)
+                dropped |= (d[i] >> (total_bits - i * digit_bits)) != 0;
+            unsigned int pos = i * digit_bits / (sizeof(unsigned int) * 8);
+            unsigned int shift = i * digit_bits % (sizeof(unsigned int) * 8);
+            for (unsigned int k = 0; k < 3 && pos + k < limbs; ++k)
+            {
+                int s = (int)(k * sizeof(unsigned int) * 8) - (int)shift;
+                if (s >= 64)
+                    break;
+                x[pos + k] |= (unsigned int)(s < 0 ? d[i] << -s : d[i] >> s);
+            }
+        }
+        return dropped;
+    }
+
+    /**
+     * @param m0 the lowest 64 bits of an odd modulus
+     * @return -m0^(-1) mod 2^digit_bits
+     */
+    inline unsigned long long digit_inverse(const unsigned long long &m0, const unsigned int &digit_bits)
+    {
+        // Newton iteration, every step doubles the correct bits
+        unsigned long long inv = m0;
+        for (unsigned short i = 0; i < 5; ++i)
+            inv *= 2 - m0 * inv;
+        return digit_bits < 64 ? (0ULL - inv) & ((1ULL << digit_bits) - 1) : 0ULL - inv;
+    }
+
+#ifdef MONTGOMERY_X86_KERNELS
+    /**
+     * Adds x * y to t[0..count], the low halves of the products go through the carry flag (adcx)
+     * and the high halves through the overflow flag (adox), so the additions of a row don't wait for each other.
+     * The row is written in assembly: the compilers lower _addcarryx_u64 to adc, and the loop counter
+     * is updated with lea and tested with jrcxz, which leave both flags alone.
+     * @return the carry out of t[count]
+     */
+    __attribute__((target("bmi2,adx"))) inline unsigned char addmul_row_adx(unsigned long long *t, const unsigned long long *x, const unsigned long long &y, const unsigned int &count)
+    {
+        unsigned long long left = count;
+        unsigned long long lo;
+        unsigned long long hi;
+        unsigned long long zero;
+        unsigned char c1;
+        unsigned char c2;
+        __asm__ volatile(
+            // clears both flags
+            "xorl %k[zero], %k[zero]\n\t"
+            "1:\n\t"
+            "jrcxz 2f\n\t"
+            "mulxq (%[x]), %[lo], %[hi]\n\t"
+            "adcxq (%[t]), %[lo]\n\t"
+            "movq %[lo], (%[t])\n\t"
+            "adoxq 8(%[t]), %[hi]\n\t"
+            "movq %[hi], 8(%[t])\n\t"
+            "leaq 8(%[x]), %[x]\n\t"
+            "leaq 8(%[t]), %[t]\n\t"
+            "leaq -1(%[left]), %[left]\n\t"
+            "jmp 1b\n\t"
+            "2:\n\t"
+            // the pending carry of the low chain belongs to t[count], the one of the high chain to the word above it
+            "movq (%[t]), %[lo]\n\t"
+            "adcxq %[zero], %[lo]\n\t"
+            "movq %[lo], (%[t])\n\t"
+            "setc %[c1]\n\t"
+            "seto %[c2]"
+            : [t] "+r"(t), [x] "+r"(x), [left] "+c"(left), [lo] "=&r"(lo), [hi] "=&r"(hi), [zero] "=&r"(zero), [c1] "=&r"(c1), [c2] "=&r"(c2)
+            : "d"(y)
+            : "cc", "memory");
+        return c1 + c2;
+    }
+
+    /**
+     * Montgomery multiplication on 64 bit words with BMI2 and ADX, every multiply-accumulate row
+     * is followed by a reduction row that zeroes the lowest word of the running sum starting at t[i].
+     * @param t 2 * count + 2 zeroed elements, the result is at t + count, it's less than 2 * m
+     * @param a, b, m count words
+     * @param m_prime -m^(-1) mod 2^64
+     */
+    __attribute__((target("bmi2,adx"))) inline void multiply_adx(unsigned long long *t, const unsigned long long *a, const unsigned long long *b, const unsigned long long *m,
+                                                                 const unsigned long long &m_prime, const unsigned int &count)
+    {
+        for (unsigned int i = 0; i < count; ++i)
+        {
+            t[i + count + 1] += addmul_row_adx(t + i, a, b[i], count);
+            t[i + count + 1] += addmul_row_adx(t + i, m, t[i] * m_prime, count);
+        }
+    }
+
+    /**
+     * Word-by-word Montgomery multiplication in radix 2^29 with AVX2.
+     * Every row adds a * b[i] + q * m to the running sum starting at t[i]; the products are less than 2^58,
+     * so the lanes only need a carry propagation every 16 rows.
+     * @param t 2 * padded + 2 zeroed elements, the result is at t + count, it's less than 2 * m
+     * @param a, b, m padded digits, count of them are nonzero, padded is a multiple of 4
+     * @param m_prime -m^(-1) mod 2^29
+     */
+    __attribute__((target("avx2"))) inline void multiply_avx2(unsigned long long *t, const unsigned long long *a, const unsigned long long *b, const unsigned long long *m,
+                                                              const unsigned long long &m_prime, const unsigned int &count, const unsigned int &padded)
+    {
+        const unsigned long long mask = (1ULL << 29) - 1;
+        for (unsigned int i = 0; i < count; ++i)
+        {
+            unsigned long long q = (((t[i] + a[0] * b[i]) & mask) * m_prime) & mask;
+            __m256i vb = _mm256_set1_epi64x(b[i]);
+            __m256i vq = _mm256_set1_epi64x(q);
+            for (unsigned int j = 0; j < padded; j += 4)
+            {
+                __m256i x = _mm256_loadu_si256((const __m256i *)(t + i + j));
+                x = _mm256_add_epi64(x, _mm256_mul_epu32(_mm256_loadu_si256((const __m256i *)(a + j)), vb));
+                x = _mm256_add_epi64(x, _mm256_mul_epu32(_mm256_loadu_si256((const __m256i *)(m + j)), vq));
+                _mm256_storeu_si256((__m256i *)(t + i + j), x);
+            }
+            // the lowest digit is divisible by 2^29 now
+            t[i + 1] += t[i] >> 29;
+            if ((i & 15) == 15)
+                for (unsigned int j = i + 1; j < i + 1 + padded; ++j)
+                {
+                    t[j + 1] += t[j] >> 29;
+                    t[j] &= mask;
+                }
+        }
+    }
+
+    /**
+     * Word-by-word Montgomery multiplication in radix 2^52 with AVX-512 IFMA.
+     * The low and high 52 bits of the products are added to neighbouring digits in two passes,
+     * a 64 bit lane can take 4096 of them before it would overflow.
+     * @param t 2 * padded + 2 zeroed elements, the result is at t + count, it's less than 2 * m
+     * @param a, b, m padded digits, count of them are nonzero, padded is a multiple of 8
+     * @param m_prime -m^(-1) mod 2^52
+     */
+    __attribute__((target("avx512f,avx512ifma"))) inline void multiply_avx512ifma(unsigned long long *t, const unsigned long long *a, const unsigned long long *b, const unsigned long long *m,
+                                                                                  const unsigned long long &m_prime, const unsigned int &count, const unsigned int &padded)
+    {
+        const unsigned long long mask = (1ULL << 52) - 1;
+        for (unsigned int i = 0; i < count; ++i)
+        {
+            // only the low 52 bits of a[0] * b[i] are needed, they are in the low 64 bits of the product
+            unsigned long long q = (((t[i] + a[0] * b[i]) & mask) * m_prime) & mask;
+            __m512i vb = _mm512_set1_epi64(b[i]);
+            __m512i vq = _mm512_set1_epi64(q);
+            for (unsigned int j = 0; j < padded; j += 8)
+            {
+                __m512i x = _mm512_loadu_si512(t + i + j);
+                x = _mm512_madd52lo_epu64(x, _mm512_loadu_si512(a + j), vb);
+                x = _mm512_madd52lo_epu64(x, _mm512_loadu_si512(m + j), vq);
+                _mm512_storeu_si512(t + i + j, x);
+            }
+            for (unsigned int j = 0; j < padded; j += 8)
+            {
+                __m512i x = _mm512_loadu_si512(t + i + j + 1);
+                x = _mm512_madd52hi_epu64(x, _mm512_loadu_si512(a + j), vb);
+                x = _mm512_madd52hi_epu64(x, _mm512_loadu_si512(m + j), vq);
+                _mm512_storeu_si512(t + i + j + 1, x);
+            }
+            t[i + 1] += t[i] >> 52;
+        }
+    }
+#endif
+}
+
+#endif
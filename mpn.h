@@ -0,0 +1,262 @@
+#ifndef MPN_H
+#define MPN_H
+
+#include <cstring>
+
+/**
+ * Low-level functions on little-endian arrays of 32 bit limbs, named after the mpn layer of GMP.
+ * They don't allocate, take the lengths as parameters and return the carry or borrow,
+ * so the Bigint algorithms can chain them without full-width temporaries.
+ * Unless stated otherwise the result may be the same array as an input.
+ * The ones without memory functions are constexpr, so BigintConstant can use them at compile time.
+ */
+namespace mpn
+{
+    /**
+     * r = a + b
+     * @return the carry out of the top limb, 0 or 1
+     */
+    constexpr unsigned int add_n(unsigned int *r, const unsigned int *a, const unsigned int *b, const unsigned int &n)
+    {
+        unsigned long long temp = 0;
+        unsigned int carry = 0;
+        for (unsigned int i = 0; i < n; ++i)
+        {
+            temp = (unsigned long long)a[i] + (unsigned long long)b[i] + carry;
+            r[i] = (unsigned int)temp;
+            carry = temp >> (8 * sizeof(unsigned int));
+        }
+        return carry;
+    }
+
+    /**
+     * r = a - b
+     * @return the borrow out of the top limb, 0 or 1
+     */
+    constexpr unsigned int sub_n(unsigned int *r, const unsigned int *a, const unsigned int *b, const unsigned int &n)
+    {
+        unsigned long long temp = 0;
+        unsigned int borrow = 0;
+        for (unsigned int i = 0; i < n; ++i)
+        {
+            temp = (unsigned long long)a[i] - ((unsigned long long)b[i] + borrow);
+            r[i] = (unsigned int)temp;
+            borrow = temp >> (8 * sizeof(unsigned long long) - 1);
+        }
+        return borrow;
+    }
+
+    /**
+     * r = a * b
+     * @return the limb above the top of r
+     */
+    constexpr unsigned int mul_1(unsigned int *r, const unsigned int *a, const unsigned int &n, const unsigned int &b)
+    {
+        unsigned long long temp = 0;
+        unsigned int carry = 0;
+        for (unsigned int i = 0; i < n; ++i)
+        {
+            temp = (unsigned long long)a[i] * b + carry;
+            r[i] = (unsigned int)temp;
+            carry = temp >> (8 * sizeof(unsigned int));
+        }
+        return carry;
+    }
+
+    /**
+     * r += a * b
+     * @return the carry limb, it has to be added to the limb above the top of r
+     */
+    constexpr unsigned int addmul_1(unsigned int *r, const unsigned int *a, const unsigned int &n, const unsigned int &b)
+    {
+        unsigned long long temp = 0;
+        unsigned int carry = 0;
+        for (unsigned int i = 0; i < n; ++i)
+        {
+            // (2^32 - 1)^2 + 2 * (2^32 - 1) still fits into 64 bits
+            temp = (unsigned long long)a[i] * b + r[i] + carry;
+            r[i] = (unsigned int)temp;
+            carry = temp >> (8 * sizeof(unsigned int));
+        }
+        return carry;
+    }
+
+    /**
+     * r -= a * b
+     * @return the borrow limb, it has to be subtracted from the limb above the top of r
+     */
+    constexpr unsigned int submul_1(unsigned int *r, const unsigned int *a, const unsigned int &n, const unsigned int &b)
+    {
+        unsigned long long temp = 0;
+        unsigned int borrow = 0;
+        for (unsigned int i = 0; i < n; ++i)
+        {
+            temp = (unsigned long long)a[i] * b + borrow;
+            unsigned int lo = (unsigned int)temp;
+            borrow = temp >> (8 * sizeof(unsigned int));
+            if (r[i] < lo)
+                ++borrow;
+            r[i] -= lo;
+        }
+        return borrow;
+    }
+
+    /**
+     * r = a << shift, the top limb is processed first so r can start at or above a
+     * @param shift has to be less than 32, 0 is a copy
+     * @return the bits shifted out of the top limb, in the low bits
+     */
+    inline unsigned int lshift(unsigned int *r, const unsigned int *a, const unsigned int &n, const unsigned int &shift)
+    {
+        if (n == 0)
+            return 0;
+        if (shift == 0)
+        {
+            std::memmove(r, a, n * sizeof(unsigned int));
+            return 0;
+        }
+        unsigned int rshift = sizeof(unsigned int) * 8 - shift;
+        unsigned int out = a[n - 1] >> rshift;
+        for (unsigned int i = n - 1; i > 0; --i)
+            r[i] = (a[i] << shift) | (a[i - 1] >> rshift);
+        r[0] = a[0] << shift;
+        return out;
+    }
+
+    /**
+     * r = a >> shift, the bottom limb is processed first so r can start at or below a
+     * @param shift has to be less than 32, 0 is a copy
+     * @return the bits shifted out of the bottom limb, in the high bits
+     */
+    inline unsigned int rshift(unsigned int *r, const unsigned int *a, const unsigned int &n, const unsigned int &shift)
+    {
+        if (n == 0)
+            return 0;
+        if (shift == 0)
+        {
+            std::memmove(r, a, n * sizeof(unsigned int));
+            return 0;
+        }
+        unsigned int lshift = sizeof(unsigned int) * 8 - shift;
+        unsigned int out = a[0] << lshift;
+        for (unsigned int i = 0; i + 1 < n; ++i)
+            r[i] = (a[i] >> shift) | (a[i + 1] << lshift);
+        r[n - 1] = a[n - 1] >> shift;
+        return out;
+    }
+
+    /**
+     * @return -1, 0 or 1 if a is less than, equal to or greater than b
+     */
+    constexpr int cmp(const unsigned int *a, const unsigned int *b, const unsigned int &n)
+    {
+        for (unsigned int i = n; i > 0; --i)
+            if (a[i - 1] != b[i - 1])
+                return a[i - 1] < b[i - 1] ? -1 : 1;
+        return 0;
+    }
+
+    /**
+     * @return the number of limbs without the zero limbs at the top
+     */
+    constexpr unsigned int size(const unsigned int *a, unsigned int n)
+    {
+        while (n > 0 && a[n - 1] == 0)
+            --n;
+        return n;
+    }
+
+    /**
+     * Schoolbook multiplication, r = a * b
+     * @param r an + bn limbs, it can't overlap the inputs
+     */
+    inline void mul(unsigned int *r, const unsigned int *a, const unsigned int &an, const unsigned int *b, const unsigned int &bn)
+    {
+        if (bn == 0)
+        {
+            std::memset(r, 0, an * sizeof(unsigned int));
+            return;
+        }
+        r[an] = mul_1(r, a, an, b[0]);
+        for (unsigned int i = 1; i < bn; ++i)
+            r[an + i] = addmul_1(r + i, a, an, b[i]);
+    }
+
+    /**
+     * Schoolbook multiplication truncated to n limbs, r = a * b mod 2^(32 * n)
+     * Every row is shortened, so the partial products above the top of r are never computed.
+     * @param r n limbs, it can't overlap the inputs
+     */
+    constexpr void mul_low(unsigned int *r, const unsigned int *a, const unsigned int *b, const unsigned int &n)
+    {
+        for (unsigned int i = 0; i < n; ++i)
+            r[i] = 0;
+        for (unsigned int i = 0; i < n; ++i)
+            if (a[i] != 0)
+                addmul_1(r + i, b, n - i, a[i]);
+    }
+
+    /**
+     * Schoolbook division (Knuth, TAOCP vol. 2, 4.3.1, algorithm D).
+     * The divisor is normalized so its top bit is set, then every quotient limb is estimated
+     * from the top two limbs and corrected at most twice before the submul_1, and once after it.
+     * @param q nn - dn + 1 limbs for the quotient, or nullptr if only the remainder is needed
+     * @param r dn limbs for the remainder, or nullptr if only the quotient is needed
+     * @param n the dividend, nn limbs, nn >= dn
+     * @param d the divisor, dn limbs, the top one can't be 0
+     * @param scratch nn + dn + 1 limbs
+     */
+    inline void divrem(unsigned int *q, unsigned int *r, const unsigned int *n, const unsigned int &nn, const unsigned int *d, const unsigned int &dn, unsigned int *scratch)
+    {
+        const unsigned long long base = 1ULL << (sizeof(unsigned int) * 8);
+        if (dn == 1)
+        {
+            // short division, one limb at a time
+            unsigned long long rem = 0;
+            for (unsigned int i = nn; i > 0; --i)
+            {
+                rem = (rem << (sizeof(unsigned int) * 8)) | n[i - 1];
+                if (q != nullptr)
+                    q[i - 1] = (unsigned int)(rem / d[0]);
+                rem %= d[0];
+            }
+            if (r != nullptr)
+                r[0] = (unsigned int)rem;
+            return;
+        }
+        unsigned int shift = __builtin_clz(d[dn - 1]);
+        unsigned int *un = scratch;
+        unsigned int *vn = scratch + nn + 1;
+        lshift(vn, d, dn, shift);
+        un[nn] = lshift(un, n, nn, shift);
+        for (unsigned int j = nn - dn + 1; j > 0; --j)
+        {
+            unsigned int *u = un + j - 1;
+            unsigned long long num = ((unsigned long long)u[dn] << (sizeof(unsigned int) * 8)) | u[dn - 1];
+            unsigned long long qhat = num / vn[dn - 1];
+            unsigned long long rhat = num % vn[dn - 1];
+            while (qhat >= base || qhat * vn[dn - 2] > ((rhat << (sizeof(unsigned int) * 8)) | u[dn - 2]))
+            {
+                --qhat;
+                rhat += vn[dn - 1];
+                if (rhat >= base)
+                    break;
+            }
+            unsigned int borrow = submul_1(u, vn, dn, (unsigned int)qhat);
+            bool negative = u[dn] < borrow;
+            u[dn] -= borrow;
+            if (negative)
+            {
+                // the estimate was one too large, add the divisor back
+                --qhat;
+                u[dn] += add_n(u, u, vn, dn);
+            }
+            if (q != nullptr)
+                q[j - 1] = (unsigned int)qhat;
+        }
+        if (r != nullptr)
+            rshift(r, un, dn, shift);
+    }
+}
+
+#endif
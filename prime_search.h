@@ -0,0 +1,92 @@
+#ifndef PRIME_SEARCH_H
+#define PRIME_SEARCH_H
+
+#include <atomic>
+#include <mutex>
+#include <random>
+#include <vector>
+#include "bigint.h"
+#include "thread_pool.h"
+#include "memtrace.h"
+
+/**
+ * Draws a random odd candidate of exactly size bits: the top bit is set, so the product of
+ * two such primes always has 2 * size - 1 or 2 * size bits.
+ * @param x the candidate is written here, the limbs above size are cleared
+ * @param engine a random number engine producing 32 bit numbers
+ * @param size the bit size of the candidate, it has to be a multiple of 32 (see Bigint::rng)
+ */
+template <unsigned int bits, typename Allocator, typename Engine>
+void prime_candidate(Bigint<bits, Allocator> &x, Engine &engine, const unsigned int &size)
+{
+    x = Bigint<bits, Allocator>();
+    x.rng(engine, size);
+    x.storage[0] |= 1;
+    x.storage[(size - 1) / (sizeof(unsigned int) * 8)] |= 1U << ((size - 1) % (sizeof(unsigned int) * 8));
+}
+
+// the same with std::random_device
+template <unsigned int bits, typename Allocator>
+void prime_candidate(Bigint<bits, Allocator> &x, const unsigned int &size)
+{
+    std::random_device rd;
+    prime_candidate(x, rd, size);
+}
+
+/**
+ * Searches for several random primes at the same time on the threads of the pool.
+ * Every prime has its own random starting point (see prime_candidate), the candidates after it are split
+ * into disjoint streams: the s-th stream of a prime tests start + 2 * (s + k * streams).
+ * A stream that walks past size bits starts again from a new random candidate, so every prime has exactly size bits.
+ * The first accepted prime stops the rest of its streams through an atomic flag.
+ * @tparam bits number of bits used to store the integers, usually ommited in functions calls.
+ * @param pool the threads used for the search
+ * @param primes the found primes are written here
+ * @param count the number of primes to search for
+ * @param size the bit size of the primes, it has to be a multiple of 32 (see Bigint::rng)
+ * @param accept additional condition a prime has to satisfy: bool accept(const Bigint<bits> &)
+ */
+template <unsigned int bits, typename Accept>
+void parallel_prime_search(ThreadPool &pool, Bigint<bits> *primes, const unsigned int &count, const unsigned int &size, Accept accept)
+{
+    // at least one stream per prime, otherwise every thread gets one stream (the caller thread too)
+    unsigned int streams = (pool.size() + 1 + count - 1) / count;
+    std::vector<std::atomic<bool> > found(count);
+    std::vector<Bigint<bits> > starts(count);
+    std::mutex result_lock;
+    for (unsigned int i = 0; i < count; ++i)
+    {
+        found[i] = false;
+        prime_candidate(starts[i], size);
+    }
+    pool.parallel_for(count * streams, 1, [&](size_t begin, size_t end)
+                      {
+                          for (size_t w = begin; w < end; ++w)
+                          {
+                              unsigned int i = w % count;
+                              Bigint<bits> candidate = starts[i] + Bigint<bits>(2ULL * (w / count));
+                              const Bigint<bits> step(2ULL * streams);
+                              while (!found[i])
+                              {
+                                  if (candidate.num_bits() > size)
+                                  {
+                                      prime_candidate(candidate, size);
+                                      continue;
+                                  }
+                                  if (candidate.prime_check() && accept(candidate))
+                                  {
+                                      // only the first confirmed prime is kept
+                                      std::lock_guard<std::mutex> guard(result_lock);
+                                      if (!found[i])
+                                      {
+                                          primes[i] = candidate;
+                                          found[i] = true;
+                                      }
+                                  }
+                                  candidate = candidate + step;
+                              }
+                          }
+                      });
+}
+
+#endif
@@ -0,0 +1,333 @@
+#ifndef RSA_KEY_H
+#define RSA_KEY_H
+
+#include <iostream>
+#include <random>
+#include "bigint.h"
+#include "montgomery.h"
+#include "bigint_batch.h"
+#include "prime_search.h"
+#include "thread_pool.h"
+#include "memtrace.h"
+
+// use this macro to display additional information about the primes, decryption key, etc...
+//#define DEBUG
+
+/**
+ * Defines the bit-width of the bigints used by the keys and the message, the key_size of the rsa algorithm
+ * and the primes used for the key creation.
+ */
+enum message_size
+{
+    // bigint_size has to be twice the size of key_size as we need to account for multiplication inside the algorithms
+    bigint_size = 256,
+    // key_size has to be twice the size of the primes as this is created through their multiplication
+    key_size = 128,
+    // we use the value of prime_size to determine the values of the above two
+    prime_size = 64,
+    // c_size can always stay 32 bits, it just has to be smaller than the primes
+    c_size = 32,
+    // the fixed encryption exponent (c) used by default: 2^16 + 1
+    public_exponent = 65537,
+};
+
+/**
+ * Number of blocks encrypted or decrypted together by the lane-parallel Montgomery kernels,
+ * a multiple of 8 fills the AVX-512 and the AVX2 kernels too.
+ */
+enum batch_size
+{
+    batch_lanes = 8,
+};
+
+/**
+ * Selects how the encryption exponent (c) is chosen during key generation.
+ */
+enum exponent_mode
+{
+    // c is always public_exponent, encryption uses a compile-time addition chain
+    fixed_exponent,
+    // c is a random prime of c_size bits
+    random_exponent,
+};
+
+/**
+ * The public part of the key pair: the modulus and the encryption exponent (c).
+ */
+struct PublicKey
+{
+    Bigint<bigint_size> modulus;
+    Bigint<bigint_size> exponent;
+    MontgomeryContext<bigint_size> montgomery;
+    MontgomeryBatch<bigint_size, batch_lanes> montgomery_batch;
+    // true if the exponent is public_exponent
+    bool is_fixed_exponent;
+    PublicKey(const Bigint<bigint_size> &, const Bigint<bigint_size> &);
+    // encrypts a single block, it has to be less than the modulus
+    Bigint<bigint_size> encrypt(const Bigint<bigint_size> &) const;
+    // encrypts batch_lanes blocks at once
+    BigintBatch<bigint_size, batch_lanes> encrypt(const BigintBatch<bigint_size, batch_lanes> &) const;
+};
+
+/**
+ * The private part of the key pair. Besides the decryption exponent it stores
+ * the values needed for decryption with the Chinese remainder theorem (CRT).
+ */
+struct PrivateKey
+{
+    Bigint<bigint_size> primes[2];
+    Bigint<bigint_size> modulus;
+    // the decryption exponent, the modular multiplicative inverse of c
+    Bigint<bigint_size> exponent;
+    // exponent mod (p - 1) and exponent mod (q - 1)
+    Bigint<bigint_size> crt_exponents[2];
+    // q^(-1) mod p, stored in the Montgomery domain of p
+    Bigint<bigint_size> q_inverse;
+    MontgomeryContext<bigint_size> montgomery_p;
+    MontgomeryContext<bigint_size> montgomery_q;
+    MontgomeryBatch<bigint_size, batch_lanes> montgomery_batch_p;
+    MontgomeryBatch<bigint_size, batch_lanes> montgomery_batch_q;
+    PrivateKey(const Bigint<bigint_size> &, const Bigint<bigint_size> &, const Bigint<bigint_size> &);
+    // decrypts a single block
+    Bigint<bigint_size> decrypt(const Bigint<bigint_size> &) const;
+    // decrypts batch_lanes blocks at once
+    BigintBatch<bigint_size, batch_lanes> decrypt(const BigintBatch<bigint_size, batch_lanes> &) const;
+
+private:
+    // combines the results modulo p and q into the result modulo the modulus
+    Bigint<bigint_size> crt_combine(const Bigint<bigint_size> &, const Bigint<bigint_size> &) const;
+};
+
+/**
+ * A reusable RSA key pair, it's generated once and can be used for any number of messages.
+ */
+struct RsaKeyPair
+{
+    PublicKey public_key;
+    PrivateKey private_key;
+    // generates a new key pair from random primes
+    RsaKeyPair(const exponent_mode & = fixed_exponent);
+    // generates a new key pair, the primes are searched for on the threads of the pool
+    RsaKeyPair(ThreadPool &, const exponent_mode & = fixed_exponent);
+    // generates a new key pair, the primes are drawn from the given engine so the result is reproducible
+    RsaKeyPair(std::mt19937 &, const exponent_mode & = fixed_exponent);
+    // creates the key pair from the given primes and encryption exponent
+    RsaKeyPair(const Bigint<bigint_size> &, const Bigint<bigint_size> &, const Bigint<bigint_size> &);
+
+private:
+    struct key_material
+    {
+        Bigint<bigint_size> primes[2];
+        Bigint<bigint_size> c;
+    };
+    static key_material generate(const exponent_mode &, ThreadPool *, std::mt19937 *);
+    RsaKeyPair(const key_material &);
+};
+
+/**
+ * @param n the modulus (the product of the primes)
+ * @param c the encryption exponent
+ */
+inline PublicKey::PublicKey(const Bigint<bigint_size> &n, const Bigint<bigint_size> &c)
+    : modulus(n), exponent(c), montgomery(n), montgomery_batch(n), is_fixed_exponent(c == BigintConstant<bigint_size>(public_exponent))
+{
+}
+
+inline Bigint<bigint_size> PublicKey::encrypt(const Bigint<bigint_size> &x) const
+{
+    if (is_fixed_exponent)
+        return montgomery.exponentiation<public_exponent>(x);
+    return montgomery.exponentiation(x, exponent);
+}
+
+/**
+ * @param x one block in every lane, the unused lanes can be 0
+ */
+inline BigintBatch<bigint_size, batch_lanes> PublicKey::encrypt(const BigintBatch<bigint_size, batch_lanes> &x) const
+{
+    if (is_fixed_exponent)
+        return montgomery_batch.exponentiation<public_exponent>(x);
+    return montgomery_batch.exponentiation(x, exponent);
+}
+
+/**
+ * @param p first prime
+ * @param q second prime, it has to be different from p
+ * @param c the encryption exponent, it has to be coprime with lcm(p - 1, q - 1)
+ */
+inline PrivateKey::PrivateKey(const Bigint<bigint_size> &p, const Bigint<bigint_size> &q, const Bigint<bigint_size> &c)
+    : modulus(p * q), montgomery_p(p), montgomery_q(q), montgomery_batch_p(p), montgomery_batch_q(q)
+{
+    primes[0] = p;
+    primes[1] = q;
+    // calculate the Carmichael's totient function
+    // here the 2 inputs are the primes - 1 (the result of Euler's function, how many coprimes a given number has below them)
+    // then we have to calculate the lcm of the primes - 1
+    // we can do this as |a*b|/gcd(a,b)
+    Bigint<bigint_size> one(1);
+    Bigint<bigint_size> temp1(p - one);
+    Bigint<bigint_size> temp2(q - one);
+    Bigint<bigint_size> lambda = (temp1 * temp2) / temp1.gcd(temp2);
+    // determine the decryption key by getting the modular multiplicative inverse of c
+    exponent = c.inverse(lambda);
+    crt_exponents[0] = exponent % temp1;
+    crt_exponents[1] = exponent % temp2;
+    q_inverse = montgomery_p.to_montgomery((q % p).inverse(p));
+#ifdef DEBUG
+    std::cout << "lambda: " << lambda << std::endl;
+    std::cout << "decryption key: " << exponent << std::endl;
+#endif
+}
+
+/**
+ * Decryption with the Chinese remainder theorem, the two half-size exponentiations
+ * are combined with Garner's formula.
+ * @param x the encrypted block, it has to be less than the modulus
+ */
+inline Bigint<bigint_size> PrivateKey::decrypt(const Bigint<bigint_size> &x) const
+{
+    Bigint<bigint_size> m1 = montgomery_p.exponentiation(x, crt_exponents[0]);
+    Bigint<bigint_size> m2 = montgomery_q.exponentiation(x, crt_exponents[1]);
+    return crt_combine(m1, m2);
+}
+
+/**
+ * The exponentiations modulo p and q run on all lanes at once, only Garner's formula is done lane by lane.
+ * @param x one encrypted block in every lane, the unused lanes can be 0
+ */
+inline BigintBatch<bigint_size, batch_lanes> PrivateKey::decrypt(const BigintBatch<bigint_size, batch_lanes> &x) const
+{
+    BigintBatch<bigint_size, batch_lanes> m1 = montgomery_batch_p.exponentiation(x, crt_exponents[0]);
+    BigintBatch<bigint_size, batch_lanes> m2 = montgomery_batch_q.exponentiation(x, crt_exponents[1]);
+    BigintBatch<bigint_size, batch_lanes> res;
+    for (unsigned int l = 0; l < batch_lanes; ++l)
+        res.set(l, crt_combine(m1.get(l), m2.get(l)));
+    return res;
+}
+
+/**
+ * Garner's formula: m2 + q * (q^(-1) * (m1 - m2) mod p)
+ * @param m1 the result modulo p
+ * @param m2 the result modulo q
+ */
+inline Bigint<bigint_size> PrivateKey::crt_combine(const Bigint<bigint_size> &m1, const Bigint<bigint_size> &m2) const
+{
+    // h = q^(-1) * (m1 - m2) mod p
+    Bigint<bigint_size> m2_p = m2 < primes[0] ? m2 : m2 % primes[0];
+    Bigint<bigint_size> diff = m1 < m2_p ? m1 + primes[0] - m2_p : m1 - m2_p;
+    Bigint<bigint_size> h = montgomery_p.multiply(diff, q_inverse);
+    return m2 + h * primes[1];
+}
+
+/**
+ * @param mode fixed_exponent uses public_exponent as c, random_exponent searches for a random prime c
+ */
+inline RsaKeyPair::RsaKeyPair(const exponent_mode &mode) : RsaKeyPair(generate(mode, NULL, NULL))
+{
+}
+
+/**
+ * @param pool p and q are searched for at the same time, each on half of the threads
+ * @param mode fixed_exponent uses public_exponent as c, random_exponent searches for a random prime c
+ */
+inline RsaKeyPair::RsaKeyPair(ThreadPool &pool, const exponent_mode &mode) : RsaKeyPair(generate(mode, &pool, NULL))
+{
+}
+
+/**
+ * @param engine the source of the random candidates for the primes and c
+ * @param mode fixed_exponent uses public_exponent as c, random_exponent searches for a random prime c
+ */
+inline RsaKeyPair::RsaKeyPair(std::mt19937 &engine, const exponent_mode &mode) : RsaKeyPair(generate(mode, NULL, &engine))
+{
+}
+
+/**
+ * @param p first prime
+ * @param q second prime, it has to be different from p
+ * @param c the encryption exponent, it has to be coprime with lcm(p - 1, q - 1)
+ */
+inline RsaKeyPair::RsaKeyPair(const Bigint<bigint_size> &p, const Bigint<bigint_size> &q, const Bigint<bigint_size> &c)
+    : public_key(p * q, c), private_key(p, q, c)
+{
+}
+
+inline RsaKeyPair::RsaKeyPair(const key_material &x) : RsaKeyPair(x.primes[0], x.primes[1], x.c)
+{
+}
+
+/**
+ * @param mode decides how c is chosen
+ * @param pool if it's not NULL the primes are searched for in parallel
+ * @param engine if it's not NULL the candidates are drawn from it instead of std::random_device
+ */
+inline RsaKeyPair::key_material RsaKeyPair::generate(const exponent_mode &mode, ThreadPool *pool, std::mt19937 *engine)
+{
+    key_material res;
+    Bigint<bigint_size> one(1);
+    const Bigint<bigint_size> fixed_c(public_exponent);
+    // with a fixed c, p - 1 can't be a multiple of c otherwise c has no inverse
+    auto accept_prime = [&](const Bigint<bigint_size> &x)
+    {
+        return mode != fixed_exponent || (x - one) % fixed_c != BigintConstant<bigint_size>();
+    };
+    if (pool != NULL)
+    {
+        // generate the 2 primes for the algorithm at the same time
+        do
+        {
+            parallel_prime_search(*pool, res.primes, 2, prime_size, accept_prime);
+        } while (res.primes[0] == res.primes[1]);
+    }
+    else
+    {
+        // generate the 2 primes for the algorithm
+        for (unsigned short i = 0; i < 2; ++i)
+        {
+            // we generate a new number until we find a prime
+            Bigint<bigint_size> my_prime;
+            do
+            {
+                if (engine != NULL)
+                    prime_candidate(my_prime, *engine, prime_size);
+                else
+                    prime_candidate(my_prime, prime_size);
+            } while (!my_prime.prime_check() || (i == 1 && my_prime == res.primes[0]) || !accept_prime(my_prime));
+            res.primes[i] = my_prime;
+        }
+    }
+#ifdef DEBUG
+    std::cout << "primes found: " << res.primes[0] << ", " << res.primes[1] << std::endl;
+#endif
+    if (mode == fixed_exponent)
+    {
+        res.c = fixed_c;
+        return res;
+    }
+    Bigint<bigint_size> temp1(res.primes[0] - one);
+    Bigint<bigint_size> temp2(res.primes[1] - one);
+    Bigint<bigint_size> lambda = (temp1 * temp2) / temp1.gcd(temp2);
+    // find a c such that c is invertible modulo lambda
+    auto accept_c = [&](const Bigint<bigint_size> &x)
+    {
+        return lambda.gcd(x) == one;
+    };
+    if (pool != NULL)
+        parallel_prime_search(*pool, &res.c, 1, c_size, accept_c);
+    else
+    {
+        do
+        {
+            if (engine != NULL)
+                prime_candidate(res.c, *engine, c_size);
+            else
+                prime_candidate(res.c, c_size);
+        } while (!res.c.prime_check() || !accept_c(res.c));
+    }
+#ifdef DEBUG
+    std::cout << "c: " << res.c << std::endl;
+#endif
+    return res;
+}
+
+#endif
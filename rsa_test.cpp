@@ -1,9 +1,144 @@
 #include <iostream>
+#ifdef MEMTRACE_SAMPLE
+#include <sys/mman.h>
+#endif
 #include "gtest_lite.h"
 #include "bigint.h"
 #include "message.h"
+#include "key_pool.h"
 #include "memtrace.h"
 
+// the slow end-to-end tests run in parallel worker processes, see RUN_ALL_TESTS() at the end of main
+REGISTER_TEST(RSA, random exponent)
+{
+    Message text("random exponent");
+    Message original(text);
+    RsaKeyPair keys(random_exponent);
+    EXPECT_FALSE(keys.public_key.is_fixed_exponent);
+    text.encrypt(keys.public_key);
+    text.decrypt(keys.private_key);
+    EXPECT_EQ(original, text);
+}
+
+REGISTER_TEST(RSA, key pair reuse)
+{
+    // 2^64 - 59 and 2^63 - 25 are primes
+    Bigint<bigint_size> p("FFFFFFFFFFFFFFC5");
+    Bigint<bigint_size> q("7FFFFFFFFFFFFFE7");
+    Bigint<bigint_size> c(65537);
+    RsaKeyPair keys(p, q, c);
+    Bigint<bigint_size> x("123456789ABCDEF0123456789");
+    Bigint<bigint_size> encrypted = keys.public_key.encrypt(x);
+    EXPECT_EQ(x.exponentiation(c, p * q), encrypted) << "encryption failed";
+    EXPECT_EQ(x, keys.private_key.decrypt(encrypted)) << "CRT decryption failed";
+    Message first("first message");
+    Message second("second message");
+    Message first_copy(first);
+    Message second_copy(second);
+    first.encrypt(keys.public_key);
+    second.encrypt(keys.public_key);
+    EXPECT_THROW(first.encrypt(keys.public_key), std::logic_error);
+    first.decrypt(keys.private_key);
+    second.decrypt(keys.private_key);
+    EXPECT_EQ(first_copy, first);
+    EXPECT_EQ(second_copy, second);
+}
+
+REGISTER_TEST(RSA, parallel encryption and decryption)
+{
+    std::string text;
+    for (unsigned int i = 0; i < 3 * parallel_threshold; ++i)
+        text += (char)('a' + i % 26);
+    Message original(text);
+    Message serial(text);
+    Message parallel(text);
+    RsaKeyPair keys;
+    ThreadPool pool(4);
+    EXPECT_EQ(4U, pool.size());
+    serial.encrypt(keys.public_key);
+    parallel.encrypt(keys.public_key, pool);
+    EXPECT_EQ(serial, parallel) << "parallel encryption failed";
+    parallel.decrypt(keys.private_key, pool);
+    EXPECT_EQ(original, parallel) << "parallel decryption failed";
+    EXPECT_THROW(pool.parallel_for(10, 1, [](size_t begin, size_t) { if (begin == 5) throw std::logic_error("chunk failed"); }), std::logic_error);
+    // tiny chunks are stolen right after they are pushed, a miscounted pending would keep the destructor from returning
+    for (int round = 0; round < 50; ++round)
+    {
+        ThreadPool busy(4);
+        std::atomic<size_t> sum(0);
+        busy.parallel_for(64, 1, [&sum](size_t begin, size_t) { sum += begin; });
+        EXPECT_EQ((size_t)(63 * 64 / 2), sum.load()) << "a chunk was lost or run twice";
+    }
+}
+
+REGISTER_TEST(RSA, parallel key generation)
+{
+    ThreadPool pool(3);
+    Bigint<bigint_size> primes[2];
+    Bigint<bigint_size> three(3);
+    parallel_prime_search(pool, primes, 2, 32, [&three](const Bigint<bigint_size> &x) { return x % three == Bigint<bigint_size>(2); });
+    EXPECT_TRUE(primes[0].prime_check()) << "first prime failed";
+    EXPECT_TRUE(primes[1].prime_check()) << "second prime failed";
+    EXPECT_EQ(Bigint<bigint_size>(2), primes[1] % three) << "accept condition failed";
+    EXPECT_EQ(32U, primes[0].num_bits()) << "prime size failed";
+    EXPECT_EQ(32U, primes[1].num_bits()) << "prime size failed";
+    RsaKeyPair keys(pool, random_exponent);
+    // the pool and the serial search give keys of the same size
+    std::mt19937 engine(5);
+    RsaKeyPair serial(engine, random_exponent);
+    EXPECT_TRUE(keys.public_key.modulus.num_bits() >= 2 * prime_size - 1 && keys.public_key.modulus.num_bits() <= 2 * prime_size) << "parallel key size failed";
+    EXPECT_TRUE(serial.public_key.modulus.num_bits() >= 2 * prime_size - 1 && serial.public_key.modulus.num_bits() <= 2 * prime_size) << "serial key size failed";
+    EXPECT_EQ((unsigned int)c_size, keys.public_key.exponent.num_bits()) << "parallel exponent size failed";
+    EXPECT_EQ((unsigned int)c_size, serial.public_key.exponent.num_bits()) << "serial exponent size failed";
+    Message text("parallel key generation");
+    Message original(text);
+    text.encrypt(keys.public_key, pool);
+    text.decrypt(keys.private_key, pool);
+    EXPECT_EQ(original, text);
+}
+
+REGISTER_TEST(RSA, key pool)
+{
+    BoundedQueue<int> queue(3);
+    EXPECT_EQ((size_t)4, queue.capacity());
+    int x = 0;
+    for (int i = 0; i < 4; ++i)
+        EXPECT_TRUE(queue.push(i));
+    EXPECT_FALSE(queue.push(4)) << "push to a full queue failed";
+    for (int i = 0; i < 4; ++i)
+    {
+        EXPECT_TRUE(queue.pop(x));
+        EXPECT_EQ(i, x);
+    }
+    EXPECT_FALSE(queue.pop(x)) << "pop from an empty queue failed";
+
+    KeyPool pool(2, 1);
+    std::unique_ptr<RsaKeyPair> keys = pool.acquire();
+    EXPECT_NE((RsaKeyPair *)NULL, keys.get());
+    Message text("key pool");
+    Message original(text);
+    text.encrypt(keys->public_key);
+    text.decrypt(keys->private_key);
+    EXPECT_EQ(original, text);
+    pool.try_acquire();
+    EXPECT_EQ(2UL, pool.hits() + pool.misses());
+
+    EXPECT_THROW(KeyPool(2, 0), std::invalid_argument);
+    EXPECT_THROW(KeyPool(2, 3), std::invalid_argument);
+
+    // after draining, the refill threads bring the pool back to the low-water mark
+    KeyPool refilled(4, 2, 2);
+    for (int round = 0; round < 3; ++round)
+    {
+        for (int i = 0; i < 500 && refilled.size() < 2; ++i)
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        EXPECT_EQ((size_t)2, refilled.size()) << "refill to the low-water mark failed";
+        while (refilled.try_acquire())
+            ;
+        EXPECT_TRUE(refilled.size() <= 4) << "stored count wrapped around";
+    }
+}
+
 int main()
 {
     TEST(Constructor from integer, x = ABCDEF98)
@@ -39,6 +174,15 @@ int main()
         EXPECT_EQ(true, x.is_odd()) << "x should be odd";
     }
     END
+    TEST(Operation, comparison)
+    {
+        Bigint<128> x("100000000");
+        Bigint<128> y("100000001");
+        EXPECT_TRUE(x < y) << "less than failed";
+        EXPECT_TRUE(y > x) << "greater than failed";
+        EXPECT_FALSE(x < x) << "less than failed on equal inputs";
+    }
+    END
     TEST(Operation, addition)
     {
         Bigint<256> x("23497ab638923c8934dfe231988");
@@ -79,7 +223,14 @@ int main()
         Bigint<256> x("bcd52348edf0909349819d8c881391812b");
         Bigint<256> y("23497ab638923c8934dfe231988");
         Bigint<256> res("1a07571e0466128867f36489d9e7dc1f3ed243873ce31b2f8882fedcad1d8");
-        EXPECT_EQ(res, x * y) << "multiplication failed";
+        EXPECT_EQ(res, Bigint<256>(x * y)) << "multiplication failed";
+        // a product stored with auto refers to the operands, it can only be evaluated with std::move
+        typedef decltype(x * y) product;
+        static_assert(std::is_convertible<product &&, Bigint<256> >::value, "product conversion failed");
+        static_assert(!std::is_convertible<product &, Bigint<256> >::value, "named product can be evaluated");
+        static_assert(!std::is_convertible<const product &, Bigint<256> >::value, "named product can be evaluated");
+        auto stored = x * y;
+        EXPECT_EQ(res, Bigint<256>(std::move(stored))) << "moved product failed";
     }
     END
     TEST(Operation, division)
@@ -98,6 +249,156 @@ int main()
         EXPECT_EQ(res, x % y) << "modulo failed";
     }
     END
+    TEST(Operation, division by zero)
+    {
+        Bigint<256> x("bcd52348edf0909349819d8c881391812b");
+        EXPECT_THROW(x / Bigint<256>(), std::domain_error);
+        EXPECT_THROW(x % Bigint<256>(), std::domain_error);
+        // a dividend less than the divisor gives a zero quotient
+        EXPECT_EQ(Bigint<256>(), Bigint<256>(5) / x) << "small quotient failed";
+    }
+    END
+    TEST(Operation, constant bigint)
+    {
+        // evaluated by the compiler
+        static_assert(0x10001_big == BigintConstant<64>(65537), "hexadecimal literal failed");
+        static_assert(65537_big == 0x10001_big && 0b11_big == 3_big && 017_big == 15_big, "literal bases failed");
+        static_assert((0xFFFFFFFF_big + 1_big) == (1_big << 32), "constant carry failed");
+        static_assert(((1_big << 40) >> 39) == 2_big, "constant shift failed");
+        static_assert(0x1234'5678'9ABC'DEF0_big * 0x10_big == 0x2345'6789'ABCD'EF00_big, "constant product failed");
+        static_assert(BigintConstant<64>(0x123456789ABCDEF0ULL) * 0x10_big == 0x23456789ABCDEF00_big, "truncated constant product failed");
+        static_assert(BigintConstant<128>("FEDCBA987654321") - BigintConstant<128>("123456789ABCDEF") == 0xECA8641FDB97532_big, "constant subtraction failed");
+        static_assert((0x1'0000'0000'0000'0000_big).num_bits() == 65, "constant num_bits failed");
+        constexpr BigintConstant<256> wide = 0xbcd52348edf0909349819d8c881391812b_big;
+        Bigint<256> x("bcd52348edf0909349819d8c881391812b");
+        BigintStats before = BigintStats::snapshot();
+        bool equal = x == wide;
+        bool less = x < 0xbcd52348edf0909349819d8c881391812c_big;
+        bool greater = x > 0x10001_big;
+        EXPECT_EQ(0ULL, (BigintStats::snapshot() - before).total(op_allocation)) << "constant comparison allocated";
+        EXPECT_TRUE(equal && less && greater) << "constant comparison failed";
+        EXPECT_EQ(x, Bigint<256>(wide)) << "constant conversion failed";
+        Bigint<256> c = 0x10001_big;
+        EXPECT_EQ(Bigint<256>(65537), c) << "literal conversion failed";
+    }
+    END
+    TEST(Operation, scratch arena)
+    {
+        ScratchArena &arena = ScratchArena::local();
+        ScratchArena::Mark start = arena.mark();
+        arena.reset_high_water();
+        size_t base = arena.high_water();
+        unsigned int *a;
+        {
+            ScratchScope outer;
+            a = outer.limbs(100);
+            {
+                ScratchScope inner;
+                // more than the first chunk, it needs a new one
+                unsigned int *b = inner.limbs(64 * 1024);
+                b[64 * 1024 - 1] = 1;
+                EXPECT_TRUE(b != a) << "nested scratch overlaps";
+            }
+            EXPECT_EQ(0U, (unsigned int)((size_t)a % 64)) << "scratch isn't aligned";
+        }
+        {
+            // the outer scope is released, the same limbs are handed out again
+            ScratchScope again;
+            EXPECT_TRUE(again.limbs(100) == a) << "released scratch isn't reused";
+        }
+        EXPECT_TRUE(arena.high_water() >= base + (112 + 64 * 1024) * sizeof(unsigned int)) << "high-water mark failed";
+        EXPECT_EQ(start.in_use, arena.mark().in_use) << "scope didn't release";
+        // wide modexp: after the first call no more chunks are allocated
+        std::mt19937 engine(11);
+        Bigint<8192> m;
+        m.rng(engine, 8192);
+        m.storage[0] |= 1;
+        Bigint<8192> x;
+        x.rng(engine, 8000);
+        Bigint<8192> e;
+        e.rng(engine, 32);
+        Bigint<8192> first = x.exponentiation(e, m);
+        unsigned long long chunks = arena.chunk_allocations();
+        EXPECT_EQ(first, x.exponentiation(e, m)) << "wide exponentiation failed";
+        EXPECT_EQ(first % m, (x.exponentiation(e, m) * Bigint<8192>(1)) % m) << "wide fused reduction failed";
+        EXPECT_EQ(chunks, arena.chunk_allocations()) << "steady state allocated scratch";
+    }
+    END
+    TEST(Operation, pool allocator)
+    {
+        typedef Bigint<1024, BigintPoolAllocator> PoolBigint;
+        std::mt19937 engine(13);
+        Bigint<1024> a, m;
+        a.rng(engine, 1000);
+        m.rng(engine, 1024);
+        m.storage[0] |= 1;
+        PoolBigint pa(a), pm(m);
+        EXPECT_EQ(Bigint<1024>(a * a % m), Bigint<1024>(PoolBigint(pa * pa % pm))) << "pooled arithmetic failed";
+        EXPECT_EQ(a.exponentiation(Bigint<1024>(65537), m, barrett_reduction), Bigint<1024>(pa.exponentiation(PoolBigint(65537), pm, barrett_reduction))) << "pooled exponentiation failed";
+        // the last freed block is the next one allocated
+        unsigned int *freed;
+        {
+            PoolBigint x(a);
+            freed = x.storage;
+        }
+        PoolBigint y(a);
+        EXPECT_TRUE(y.storage == freed) << "freed block isn't reused";
+        // the blocks freed on another thread return to this one, no more chunks are needed the second time
+        std::vector<PoolBigint> numbers(2000, pa);
+        size_t chunks = LimbPool<32>::chunk_count();
+        std::thread other([&numbers]() { std::vector<PoolBigint>().swap(numbers); });
+        other.join();
+        std::vector<PoolBigint> again(2000, pm);
+        EXPECT_EQ(chunks, LimbPool<32>::chunk_count()) << "remote free didn't return the blocks";
+        EXPECT_EQ(pm, again.back());
+    }
+    END
+    TEST(Operation, fused multiplication)
+    {
+        Bigint<256> x("bcd52348edf0909349819d8c881391812b");
+        Bigint<256> y("23497ab638923c8934dfe231988");
+        Bigint<256> m("81dad55da5b9126e9f");
+        Bigint<256> product = x * y;
+        EXPECT_EQ(product % m, (x * y) % m) << "multiply-reduce failed";
+        EXPECT_EQ(product / m, (x * y) / m) << "multiply-divide failed";
+        EXPECT_EQ(product + m, m + x * y) << "multiply-accumulate failed";
+        EXPECT_EQ(product + m, x * y + m) << "multiply-accumulate failed";
+        EXPECT_THROW((x * y) % Bigint<256>(), std::domain_error);
+        // the fused operators truncate the product to bits like the evaluated one
+        Bigint<256> full("ffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffff61");
+        Bigint<256> wrapped = full * full;
+        EXPECT_EQ(wrapped % m, (full * full) % m) << "truncated multiply-reduce failed";
+        EXPECT_EQ(wrapped + x, x + full * full) << "truncated multiply-accumulate failed";
+        // the product isn't allocated, only the result
+        BigintStats before = BigintStats::snapshot();
+        Bigint<256> r = (x * y) % m;
+        EXPECT_EQ(1ULL, (BigintStats::snapshot() - before).total(op_allocation)) << "fused allocation count failed";
+    }
+    END
+    TEST(Operation, limb primitives)
+    {
+        unsigned int a[3] = {0xFFFFFFFF, 0xFFFFFFFF, 0x1};
+        unsigned int b[3] = {0x1, 0x0, 0x0};
+        unsigned int r[3];
+        EXPECT_EQ(0U, mpn::add_n(r, a, b, 3)) << "add_n carry failed";
+        EXPECT_EQ(0x2U, r[2]) << "add_n failed";
+        EXPECT_EQ(1U, mpn::add_n(r, a, b, 2)) << "add_n carry out failed";
+        EXPECT_EQ(1U, mpn::sub_n(r, b, a, 3)) << "sub_n borrow failed";
+        EXPECT_EQ(0x2U, r[0]) << "sub_n failed";
+        EXPECT_EQ(0x1U, mpn::mul_1(r, a, 2, 2)) << "mul_1 failed";
+        EXPECT_EQ(0xFFFFFFFEU, r[0]);
+        // r = 2^65 - 2, minus 2 * (2^64 - 1) is zero
+        EXPECT_EQ(0U, mpn::submul_1(r, a, 2, 2) - 1) << "submul_1 failed";
+        EXPECT_EQ(0U, r[0] | r[1]);
+        EXPECT_EQ(1U, mpn::addmul_1(r, a, 2, 2)) << "addmul_1 failed";
+        EXPECT_EQ(0x1U, mpn::lshift(r, a, 2, 1)) << "lshift failed";
+        EXPECT_EQ(0xFFFFFFFEU, r[0]);
+        EXPECT_EQ(0x80000000U, mpn::rshift(r, a, 3, 1)) << "rshift failed";
+        EXPECT_EQ(0xFFFFFFFFU, r[1]);
+        EXPECT_EQ(1, mpn::cmp(a, b, 3));
+        EXPECT_EQ(1U, mpn::size(b, 3));
+    }
+    END
     TEST(Operation, left shift)
     {
         Bigint<256> x("bcd52348edf0909349819d8c881391812b");
@@ -160,6 +461,8 @@ int main()
         Bigint<1024> m("1ae09926bc4aec40ab4e8916c56f023fb92b");
         Bigint<1024> result("d133bc208ff54618ad91d792f46a4b31957");
         EXPECT_EQ(result, e.inverse(m)) << "inverse 2 failed";
+        // no inverse if they aren't coprime
+        EXPECT_THROW(Bigint<1024>(6).inverse(Bigint<1024>(9)), std::domain_error);
     }
     END
     TEST(RSA, encryption and decryption)
@@ -171,11 +474,347 @@ int main()
         my_message = my_message + world;
         Message hello_world = my_message;
         std::cout << hello_world << std::endl;
-        hello_world.encrypt();
+        RsaKeyPair keys;
+        hello_world.encrypt(keys.public_key);
         std::cout << hello_world << std::endl;
-        hello_world.decrypt();
+        hello_world.decrypt(keys.private_key);
         std::cout << hello_world << std::endl;
         EXPECT_EQ(equal, hello_world);
     }
-    END return 0;
+    END
+    TEST(Algorithm, montgomery exponentiation)
+    {
+        Bigint<256> a("2fc49c36f3759e607989819908be7c08");
+        Bigint<256> b("944dea746e003341508a6b4b");
+        Bigint<256> m("81dad55da5b9126e9f");
+        Bigint<256> result("754c14c8901dc84ec2");
+        MontgomeryContext<256> ctx(m);
+        EXPECT_EQ(result, ctx.exponentiation(a, b)) << "montgomery exponentiation failed";
+        EXPECT_THROW(MontgomeryContext<256>(Bigint<256>(10)), std::domain_error);
+    }
+    END
+    TEST(Algorithm, montgomery kernels)
+    {
+        std::mt19937 engine(42);
+        Bigint<1024> m;
+        m.rng(engine, 800);
+        m.storage[0] |= 1;
+        Bigint<1024> a;
+        a.rng(engine, 800);
+        a = a % m;
+        Bigint<1024> b;
+        b.rng(engine, 64);
+        Bigint<1024> expected = MontgomeryContext<1024>(m, scalar_kernels).exponentiation(a, b);
+        // every kernel set the CPU supports has to give the same result, the others fall back to a supported one
+        for (int k = scalar_kernels; k <= avx512ifma_kernels; ++k)
+        {
+            MontgomeryContext<1024> ctx(m, (kernel_set)k);
+            EXPECT_EQ(expected, ctx.exponentiation(a, b)) << montgomery_kernels::name(ctx.kernels) << " exponentiation failed";
+            EXPECT_EQ(a, ctx.from_montgomery(ctx.to_montgomery(a))) << montgomery_kernels::name(ctx.kernels) << " conversion failed";
+        }
+        // a full width modulus: the results between 2^1024 and 2 * m don't fit into the Bigint
+        m.rng(engine, 1024);
+        m.storage[31] |= 0x80000000U;
+        m.storage[0] |= 1;
+        a = a.exponentiation(b, m);
+        expected = a.exponentiation(b, m);
+        for (int k = scalar_kernels; k <= avx512ifma_kernels; ++k)
+        {
+            MontgomeryContext<1024> ctx(m, (kernel_set)k);
+            EXPECT_EQ(expected, ctx.exponentiation(a, b)) << montgomery_kernels::name(ctx.kernels) << " full width exponentiation failed";
+        }
+        // the key sized moduli are too small for the other kernels
+        EXPECT_EQ(scalar_kernels, montgomery_kernels::select(key_size));
+    }
+    END
+    TEST(Algorithm, batch exponentiation)
+    {
+        std::mt19937 engine(7);
+        Bigint<1024> m;
+        m.rng(engine, 700);
+        m.storage[0] |= 1;
+        Bigint<1024> b;
+        b.rng(engine, 64);
+        MontgomeryContext<1024> ctx(m, scalar_kernels);
+        BigintBatch<1024, 8> a;
+        for (unsigned int l = 0; l < 8; ++l)
+        {
+            Bigint<1024> x;
+            x.rng(engine, 700);
+            a.set(l, x);
+        }
+        // every lane has to match the single number exponentiation, whichever lane kernel is used
+        for (int k = scalar_kernels; k <= avx512ifma_kernels; ++k)
+        {
+            MontgomeryBatch<1024, 8> batch(m, (kernel_set)k);
+            BigintBatch<1024, 8> res = batch.exponentiation(a, b);
+            BigintBatch<1024, 8> fixed = batch.exponentiation<public_exponent>(a);
+            for (unsigned int l = 0; l < 8; ++l)
+            {
+                EXPECT_EQ(ctx.exponentiation(a.get(l), b), res.get(l)) << montgomery_kernels::name(batch.kernels) << " lane " << l << " failed";
+                EXPECT_EQ(ctx.exponentiation<public_exponent>(a.get(l)), fixed.get(l)) << montgomery_kernels::name(batch.kernels) << " fixed exponent lane " << l << " failed";
+            }
+        }
+        // 3 lanes don't fill a vector, the portable kernel is used
+        EXPECT_EQ(scalar_kernels, (MontgomeryBatch<1024, 3>(m, avx2_kernels).kernels));
+    }
+    END
+    TEST(Algorithm, barrett exponentiation)
+    {
+        Bigint<256> a("2fc49c36f3759e607989819908be7c08");
+        Bigint<256> b("944dea746e003341508a6b4b");
+        Bigint<256> m("81dad55da5b9126e9f");
+        Bigint<256> result("754c14c8901dc84ec2");
+        BarrettContext<256> ctx(m);
+        EXPECT_EQ(a % m, ctx.reduce(a)) << "barrett reduction failed";
+        EXPECT_EQ((a % m) * (a % m) % m, ctx.multiply(a % m, a % m)) << "barrett multiplication failed";
+        EXPECT_EQ(result, ctx.exponentiation(a, b)) << "barrett exponentiation failed";
+        EXPECT_EQ(result, a.exponentiation(b, m, barrett_reduction)) << "barrett option failed";
+        // the modulus uses every bit, the products don't fit into 256 bits
+        Bigint<256> full("ffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffff61");
+        BarrettContext<256> wide(full);
+        EXPECT_EQ(Bigint<256>(1), wide.multiply(full - 1, full - 1)) << "full width multiplication failed";
+        EXPECT_EQ(Bigint<256>(4), wide.exponentiation(full - 2, Bigint<256>(2))) << "full width exponentiation failed";
+        // a power of 2^32 has the largest reciprocal
+        Bigint<256> power("10000000000000000");
+        EXPECT_EQ(Bigint<256>(0x12345678), BarrettContext<256>(power).reduce(Bigint<256>("abcdef0000000012345678"))) << "power of 2^32 failed";
+        EXPECT_EQ(Bigint<256>(), BarrettContext<256>(Bigint<256>(1)).exponentiation(a, b)) << "modulus 1 failed";
+        EXPECT_THROW(BarrettContext<256>(Bigint<256>()), std::domain_error);
+        // HAC 14.42 needs at most 2 corrections, also for the moduli just above a power of 2^32
+        std::mt19937 engine(3);
+        unsigned long long max_corrections = 0, corrections = 0;
+        auto widen = [](const Bigint<256> &v)
+        {
+            Bigint<512> w;
+            for (unsigned int i = 0; i < 8; ++i)
+                w.storage[i] = v.storage[i];
+            return w;
+        };
+        for (unsigned int size = 32; size <= 256; size += 32)
+            for (int i = 0; i < 200; ++i)
+            {
+                Bigint<256> mod;
+                mod.rng(engine, size);
+                mod.storage[size / 32 - 1] = i % 2 ? 1 : (mod.storage[size / 32 - 1] | 1);
+                BarrettContext<256> barrett(mod);
+                Bigint<256> x, y;
+                x.rng(engine, size);
+                y.rng(engine, size);
+                x = x % mod;
+                y = y % mod;
+                BigintStats start = BigintStats::snapshot();
+                Bigint<256> product = barrett.multiply(x, y);
+                unsigned long long count = (BigintStats::snapshot() - start).total(op_barrett_correction);
+                max_corrections = std::max(max_corrections, count);
+                corrections += count;
+                EXPECT_EQ(widen(x) * widen(y) % widen(mod), widen(product)) << "barrett multiplication failed";
+            }
+        EXPECT_TRUE(max_corrections <= 2) << "more than 2 corrections: " << max_corrections;
+        EXPECT_TRUE(corrections != 0) << "correction count failed";
+    }
+    END
+    TEST(Algorithm, addition chain exponentiation)
+    {
+        Bigint<256> a("2fc49c36f3759e607989819908be7c08");
+        Bigint<256> m("81dad55da5b9126e9f");
+        MontgomeryContext<256> ctx(m);
+        EXPECT_EQ(16U, AdditionChain<65537>::length) << "addition chain length failed";
+        EXPECT_EQ(a.exponentiation(Bigint<256>(65537), m), ctx.exponentiation<65537>(a)) << "fixed exponent 65537 failed";
+        EXPECT_EQ(a.exponentiation(Bigint<256>(0xB7), m), ctx.exponentiation<0xB7>(a)) << "fixed exponent B7 failed";
+        EXPECT_EQ(a % m, ctx.exponentiation<1>(a)) << "fixed exponent 1 failed";
+    }
+    END
+    TEST(Operation, statistics)
+    {
+        Bigint<128> a("123456789ABCDEF");
+        Bigint<128> b("FEDCBA987654321");
+        BigintStats before = BigintStats::snapshot();
+        Bigint<128> c = a * b;
+        BigintStats diff = BigintStats::snapshot() - before;
+        EXPECT_EQ(1ULL, diff.total(op_multiplication)) << "multiplication count failed";
+        EXPECT_EQ(1ULL, diff.count(op_multiplication, 128)) << "size class failed";
+        EXPECT_EQ(0ULL, diff.count(op_multiplication, 256)) << "size class failed";
+        // the result is constructed in place, that is a single allocation
+        EXPECT_EQ(1ULL, diff.total(op_allocation)) << "allocation count failed";
+        EXPECT_EQ(16ULL, diff.allocated_bytes) << "allocated bytes failed";
+        // 65537 needs 16 squarings and 1 multiplication, plus 2 conversions between the domains
+        Bigint<256> x("2fc49c36f3759e607989819908be7c08");
+        MontgomeryContext<256> ctx(Bigint<256>("81dad55da5b9126e9f"));
+        before = BigintStats::snapshot();
+        ctx.exponentiation<65537>(x);
+        EXPECT_EQ(19ULL, (BigintStats::snapshot() - before).total(op_montgomery_multiply)) << "addition chain count failed";
+        before = BigintStats::snapshot();
+        ctx.exponentiation(x, Bigint<256>(65537));
+        EXPECT_EQ(21ULL, (BigintStats::snapshot() - before).total(op_montgomery_multiply)) << "binary exponentiation count failed";
+    }
+    END
+    TEST(Operation, pool allocator threads)
+    {
+        typedef Bigint<1024, BigintPoolAllocator> PoolBigint;
+        size_t before = LimbPool<32>::chunk_count();
+        ThreadPool pool(4);
+        for (int round = 0; round < 10; ++round)
+        {
+            // this thread allocates the numbers, the workers replace them: every free crosses a thread
+            std::vector<PoolBigint> results(256);
+            pool.parallel_for(results.size(), 8, [&results](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; ++i)
+                {
+                    PoolBigint x(i + 1);
+                    for (unsigned int k = 0; k < 20; ++k)
+                        x = x * x % PoolBigint("FFFFFFFFFFFFFFC5");
+                    results[i] = x;
+                }
+            });
+            Bigint<1024> expected(256);
+            for (unsigned int k = 0; k < 20; ++k)
+                expected = expected * expected % Bigint<1024>("FFFFFFFFFFFFFFC5");
+            EXPECT_EQ(expected, Bigint<1024>(results.back())) << "pooled parallel arithmetic failed";
+        }
+        // fewer than 455 blocks are alive per thread, one chunk each is enough if the remote frees come back
+        EXPECT_LE(LimbPool<32>::chunk_count(), before + 5) << "remote frees didn't return to the owners";
+    }
+    END
+#ifdef MEMTRACE
+    TEST(Memtrace, parallel allocations)
+    {
+        int before = memtrace::allocated_blocks();
+        {
+            ThreadPool pool(4);
+            // every chunk allocates and frees Bigint temporaries at the same time as the others
+            pool.parallel_for(64, 1, [](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; ++i)
+                {
+                    Bigint<bigint_size> x(i + 1);
+                    for (unsigned int k = 0; k < 200; ++k)
+                        x = (x * x + Bigint<bigint_size>(k)) % Bigint<bigint_size>("FFFFFFFFFFFFFFC5");
+                }
+            });
+        }
+        EXPECT_EQ(before, memtrace::allocated_blocks()) << "allocation count failed";
+        int *p = new int;
+        EXPECT_TRUE(memtrace::poi_check(p));
+        delete p;
+        EXPECT_FALSE(memtrace::poi_check(p));
+    }
+    END
+#endif
+    TEST(Performance, allocations)
+    {
+        Bigint<bigint_size> a("0123456789ABCDEF"), b("FEDCBA9876543210");
+        bool less = false;
+        EXPECT_MAX_ALLOCS(0) { less = a < b; }
+        EXPECT_TRUE(less);
+        // the product is constructed in place: one limb array
+        EXPECT_MAX_ALLOCS(1)
+        {
+            Bigint<bigint_size> c = a * b;
+            EXPECT_FALSE(c.is_odd() && c.is_even());
+        }
+        // the allocations of a background thread aren't charged to the block
+        std::atomic<int> step(0);
+        std::thread background([&step]() {
+            while (step.load() == 0)
+                std::this_thread::yield();
+            for (int i = 0; i < 10; ++i)
+                delete new int(i);
+            step.store(2);
+        });
+        EXPECT_MAX_ALLOCS(0)
+        {
+            step.store(1);
+            while (step.load() != 2)
+                std::this_thread::yield();
+        }
+        background.join();
+    }
+    END
+    TEST(Performance, multiplication)
+    {
+        Bigint<bigint_size> a("0123456789ABCDEF"), b("FEDCBA9876543210"), c;
+        BENCHMARK(multiplication, 200) { c = a * b; }
+        EXPECT_EQ(200, gtest_lite::test.bench.iterations);
+        EXPECT_LE(gtest_lite::test.bench.min, gtest_lite::test.bench.median);
+        EXPECT_LE(gtest_lite::test.bench.median, gtest_lite::test.bench.max);
+        // a generous limit: it catches accidental blowups, not noise
+        EXPECT_FASTER_THAN(1000000000)
+        {
+            for (int i = 0; i < 100; ++i)
+                c = a * b;
+        }
+    }
+    END
+#ifdef MEMTRACE_PROFILE
+    TEST(Memtrace, allocation profile)
+    {
+#ifdef MEMTRACE_SAMPLE
+        unsigned int rate = memtrace::sample_rate();
+        memtrace::set_sample_rate(1); // the profile only sees tracked allocations
+#endif
+        memtrace::profile_reset();
+        for (int i = 0; i < 10; ++i)
+        {
+            int *block = new int[16];
+            delete[] block;
+        }
+#ifdef MEMTRACE_SAMPLE
+        memtrace::set_sample_rate(rate);
+#endif
+        FILE *fp = tmpfile();
+        memtrace::profile_report(1, fp);
+        rewind(fp);
+        char line[256];
+        std::string report;
+        while (fgets(line, sizeof(line), fp))
+            report += line;
+        fclose(fp);
+        // the busiest site is the new[] above: 10 blocks of 16 ints, none alive
+        std::ostringstream expected;
+        expected << 10 << ' ' << std::setw(14) << 10 * 16 * sizeof(int);
+        EXPECT_NE(std::string::npos, report.find(expected.str())) << report;
+        EXPECT_NE(std::string::npos, report.find("rsa_test.cpp")) << report;
+    }
+    END
+#endif
+#ifdef MEMTRACE_SAMPLE
+    TEST(Memtrace, sampling)
+    {
+        unsigned int rate = memtrace::sample_rate();
+        int blocks = memtrace::allocated_blocks();
+        size_t bytes = memtrace::live_bytes();
+        // most of these skip the registry, but all of them are counted
+        memtrace::set_sample_rate(1000);
+        int *p[100];
+        for (int i = 0; i < 100; ++i)
+            p[i] = new int[4];
+        EXPECT_EQ(blocks + 100, memtrace::allocated_blocks());
+        EXPECT_EQ(bytes + 100 * 4 * sizeof(int), memtrace::live_bytes());
+        for (int i = 0; i < 100; ++i)
+        {
+            EXPECT_TRUE(memtrace::poi_check(p[i]));
+            delete[] p[i];
+        }
+        EXPECT_EQ(blocks, memtrace::allocated_blocks());
+        EXPECT_EQ(bytes, memtrace::live_bytes());
+        // with rate 1 every allocation is fully tracked again
+        memtrace::set_sample_rate(1);
+        char *c = (char *)malloc(10);
+        c = (char *)realloc(c, 20);
+        EXPECT_TRUE(memtrace::poi_check(c));
+        free(c);
+        memtrace::set_sample_rate(rate);
+        // a foreign pointer at the start of a mapping: the page before it can't be read
+        char *pages = (char *)mmap(NULL, 2 * 4096, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        EXPECT_TRUE(pages != MAP_FAILED);
+        if (pages != MAP_FAILED)
+        {
+            mprotect(pages, 4096, PROT_NONE);
+            EXPECT_FALSE(memtrace::poi_check(pages + 4096)) << "foreign pointer is tracked";
+            munmap(pages, 2 * 4096);
+        }
+    }
+    END
+#endif
+    RUN_ALL_TESTS();
+    return 0;
 }
@@ -0,0 +1,183 @@
+#ifndef SCRATCH_ARENA_H
+#define SCRATCH_ARENA_H
+
+#include <cstddef>
+#include <vector>
+#include "memtrace.h"
+
+/**
+ * Scratch arrays up to this many limbs are kept on the stack, there the bump of the arena would cost more
+ * than the array itself. The larger ones, e.g. the double width products of 8192 bit numbers, come from the arena.
+ */
+enum scratch_size
+{
+    scratch_inline_limbs = 256,
+};
+
+/**
+ * Per-thread bump allocator for the temporary limb arrays of the Bigint algorithms
+ * (the double width products, the normalized operands of the division, ...).
+ * The arrays are taken in a scoped mark/release pattern through ScratchScope, so releasing is just
+ * restoring the bump pointer. The chunks are kept until the thread exits, after the first calls
+ * at a given width no more memory is allocated however wide the numbers are.
+ */
+class ScratchArena
+{
+public:
+    // position of the bump pointer, taken by mark() and restored by release()
+    struct Mark
+    {
+        size_t chunk;
+        size_t used;
+        size_t in_use;
+    };
+    // the arena of the calling thread
+    static ScratchArena &local();
+    // returns count uninitialized limbs aligned to a cache line, they're valid until the enclosing mark is released
+    unsigned int *allocate(const size_t &);
+    Mark mark() const { return Mark{chunk, used, in_use}; }
+    // frees every array allocated since the mark
+    void release(const Mark &m)
+    {
+        chunk = m.chunk;
+        used = m.used;
+        in_use = m.in_use;
+    }
+    // the most bytes in use at once since the thread started or the last reset_high_water()
+    size_t high_water() const { return high_water_limbs * sizeof(unsigned int); }
+    void reset_high_water() { high_water_limbs = in_use; }
+    // total size of the chunks
+    size_t reserved() const { return reserved_bytes; }
+    // number of chunks allocated from the heap, it stops growing in a steady state
+    unsigned long long chunk_allocations() const { return chunks.size(); }
+    ScratchArena() {}
+    ~ScratchArena();
+
+private:
+    // every thread has exactly one arena, it can't be copied (not defined)
+    ScratchArena(const ScratchArena &);
+    ScratchArena &operator=(const ScratchArena &);
+    void next_chunk(const size_t &);
+    struct Chunk
+    {
+        // as allocated and rounded up to the alignment
+        unsigned int *limbs;
+        unsigned int *base;
+        size_t capacity;
+    };
+    // 64 byte alignment, an AVX-512 register or a cache line
+    static const size_t alignment = 64 / sizeof(unsigned int);
+    // the first chunk, the later ones are at least twice as big as the previous one
+    static const size_t first_chunk = 16 * 1024;
+    std::vector<Chunk> chunks;
+    size_t chunk = 0, used = 0;
+    // the allocated limbs, including the unused ends of the chunks that were skipped
+    size_t in_use = 0;
+    size_t high_water_limbs = 0;
+    size_t reserved_bytes = 0;
+};
+
+inline ScratchArena &ScratchArena::local()
+{
+    static thread_local ScratchArena arena;
+    return arena;
+}
+
+/**
+ * The fast path is a bump of the current chunk, the next chunk is only looked at if it doesn't fit.
+ */
+inline unsigned int *ScratchArena::allocate(const size_t &count)
+{
+    size_t size = (count + alignment - 1) & ~(alignment - 1);
+    if (chunk >= chunks.size() || used + size > chunks[chunk].capacity)
+        next_chunk(size);
+    unsigned int *res = chunks[chunk].base + used;
+    used += size;
+    in_use += size;
+    if (in_use > high_water_limbs)
+        high_water_limbs = in_use;
+    return res;
+}
+
+/**
+ * Moves to the first chunk after the current one that has size free limbs, a new one is allocated if there's none.
+ */
+inline void ScratchArena::next_chunk(const size_t &size)
+{
+    while (chunk < chunks.size() && used + size > chunks[chunk].capacity)
+    {
+        // the rest of the chunk is skipped until the mark before it is released
+        in_use += chunks[chunk].capacity - used;
+        ++chunk;
+        used = 0;
+    }
+    if (chunk < chunks.size())
+        return;
+    Chunk c;
+    c.capacity = chunks.empty() ? first_chunk : 2 * chunks.back().capacity;
+    if (c.capacity < size)
+        c.capacity = size;
+    c.limbs = new unsigned int[c.capacity + alignment];
+    // new[] only guarantees the alignment of the type, the start of the chunk is rounded up
+    c.base = c.limbs + (alignment - ((size_t)c.limbs / sizeof(unsigned int)) % alignment) % alignment;
+    chunks.push_back(c);
+    reserved_bytes += c.capacity * sizeof(unsigned int);
+}
+
+inline ScratchArena::~ScratchArena()
+{
+    for (size_t i = 0; i < chunks.size(); ++i)
+        delete[] chunks[i].limbs;
+}
+
+/**
+ * Marks the arena of the calling thread when it's created and releases it when it goes out of scope,
+ * so the arrays taken through it live exactly as long as the scope, even if an exception is thrown.
+ * The scopes have to be nested, like the calls that create them.
+ */
+class ScratchScope
+{
+    ScratchArena &arena;
+    const ScratchArena::Mark saved;
+
+public:
+    ScratchScope() : arena(ScratchArena::local()), saved(arena.mark()) {}
+    ~ScratchScope() { arena.release(saved); }
+    // count uninitialized limbs
+    unsigned int *limbs(const size_t &count) { return arena.allocate(count); }
+
+private:
+    // a copy would release the same mark twice (not defined)
+    ScratchScope(const ScratchScope &);
+    ScratchScope &operator=(const ScratchScope &);
+};
+
+/**
+ * A scratch array of at most max_limbs limbs: an inline array if max_limbs is small, limbs from the
+ * arena of the thread otherwise. The limbs aren't initialized.
+ * @tparam max_limbs the compile-time bound of the size, e.g. 2 * n + 1 for the division
+ */
+template <size_t max_limbs, bool inline_array = max_limbs <= scratch_inline_limbs>
+class ScratchArray
+{
+    unsigned int data[max_limbs];
+
+public:
+    // count is ignored, the inline array always has max_limbs limbs
+    explicit ScratchArray(const size_t &) {}
+    unsigned int *limbs() { return data; }
+};
+
+template <size_t max_limbs>
+class ScratchArray<max_limbs, false>
+{
+    ScratchScope scope;
+    unsigned int *data;
+
+public:
+    // only count limbs are taken from the arena
+    explicit ScratchArray(const size_t &count) : data(scope.limbs(count)) {}
+    unsigned int *limbs() { return data; }
+};
+
+#endif
@@ -0,0 +1,187 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <deque>
+#include <vector>
+#include <functional>
+#include <exception>
+#include "memtrace.h"
+
+/**
+ * Reusable work-stealing thread pool.
+ * Every worker has its own task queue, it takes tasks from the back of its own queue
+ * and steals from the front of the other queues when its own queue is empty.
+ * The thread calling parallel_for also executes tasks until all of its chunks are done.
+ */
+class ThreadPool
+{
+    struct task_queue
+    {
+        std::mutex lock;
+        std::deque<std::function<void()> > tasks;
+    };
+    std::vector<std::thread> threads;
+    std::vector<task_queue *> queues;
+    // the number of tasks waiting in the queues
+    std::atomic<unsigned long> pending;
+    // the next queue used by push
+    std::atomic<unsigned int> next_queue;
+    std::mutex state_lock;
+    // signals the workers that there's a new task or the pool is stopping
+    std::condition_variable wake;
+    // signals the parallel_for callers that a chunk has been finished
+    std::condition_variable finished;
+    bool stopping;
+
+    ThreadPool(const ThreadPool &);
+    ThreadPool &operator=(const ThreadPool &);
+    void push(const std::function<void()> &);
+    bool pop(const unsigned int &, std::function<void()> &);
+    void work(const unsigned int);
+
+public:
+    // creates the given number of worker threads, 0 means one per hardware thread
+    ThreadPool(const unsigned int & = 0);
+    unsigned int size() const { return threads.size(); }
+    /**
+     * Splits [0, count) into chunks of chunk_size and calls f(begin, end) for every chunk.
+     * Returns after every chunk has been processed, the first exception thrown by f is rethrown.
+     */
+    template <typename F>
+    void parallel_for(const size_t &, const size_t &, F);
+    ~ThreadPool();
+};
+
+/**
+ * @param n the number of worker threads, if it's 0 std::thread::hardware_concurrency() is used
+ */
+inline ThreadPool::ThreadPool(const unsigned int &n) : pending(0), next_queue(0), stopping(false)
+{
+    unsigned int count = n != 0 ? n : std::thread::hardware_concurrency();
+    if (count == 0)
+        count = 1;
+    for (unsigned int i = 0; i < count; ++i)
+        queues.push_back(new task_queue);
+    for (unsigned int i = 0; i < count; ++i)
+        threads.push_back(std::thread(&ThreadPool::work, this, i));
+}
+
+inline void ThreadPool::push(const std::function<void()> &task)
+{
+    task_queue *q = queues[next_queue++ % queues.size()];
+    // counted before the task is visible: a thief could pop it and decrement pending first, wrapping it around
+    ++pending;
+    std::lock_guard<std::mutex> guard(q->lock);
+    q->tasks.push_back(task);
+}
+
+/**
+ * @param index the queue to take the task from first, the rest of the queues are stolen from
+ * @return true if a task was found
+ */
+inline bool ThreadPool::pop(const unsigned int &index, std::function<void()> &task)
+{
+    if (pending == 0)
+        return false;
+    for (unsigned int i = 0; i < queues.size(); ++i)
+    {
+        task_queue *q = queues[(index + i) % queues.size()];
+        std::lock_guard<std::mutex> guard(q->lock);
+        if (q->tasks.empty())
+            continue;
+        // the owner works from the back (most recently pushed), thieves from the front
+        if (i == 0)
+        {
+            task = q->tasks.back();
+            q->tasks.pop_back();
+        }
+        else
+        {
+            task = q->tasks.front();
+            q->tasks.pop_front();
+        }
+        --pending;
+        return true;
+    }
+    return false;
+}
+
+inline void ThreadPool::work(const unsigned int index)
+{
+    std::function<void()> task;
+    while (true)
+    {
+        if (pop(index, task))
+        {
+            task();
+            continue;
+        }
+        std::unique_lock<std::mutex> guard(state_lock);
+        wake.wait(guard, [this] { return stopping || pending != 0; });
+        if (stopping && pending == 0)
+            return;
+    }
+}
+
+template <typename F>
+void ThreadPool::parallel_for(const size_t &count, const size_t &chunk_size, F f)
+{
+    if (count == 0)
+        return;
+    size_t chunk = chunk_size != 0 ? chunk_size : 1;
+    // these are only modified while state_lock is held
+    size_t remaining = (count + chunk - 1) / chunk;
+    std::exception_ptr error;
+    for (size_t begin = 0; begin < count; begin += chunk)
+    {
+        size_t end = begin + chunk < count ? begin + chunk : count;
+        push([this, &f, &remaining, &error, begin, end]()
+             {
+                 std::exception_ptr e;
+                 try
+                 {
+                     f(begin, end);
+                 }
+                 catch (...)
+                 {
+                     e = std::current_exception();
+                 }
+                 std::lock_guard<std::mutex> guard(state_lock);
+                 if (e && !error)
+                     error = e;
+                 if (--remaining == 0)
+                     finished.notify_all();
+             });
+    }
+    {
+        std::lock_guard<std::mutex> guard(state_lock);
+        wake.notify_all();
+    }
+    // the caller helps with the work instead of just waiting
+    std::function<void()> task;
+    while (pop(next_queue % queues.size(), task))
+        task();
+    std::unique_lock<std::mutex> guard(state_lock);
+    finished.wait(guard, [&remaining] { return remaining == 0; });
+    if (error)
+        std::rethrow_exception(error);
+}
+
+inline ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> guard(state_lock);
+        stopping = true;
+        wake.notify_all();
+    }
+    for (size_t i = 0; i < threads.size(); ++i)
+        threads[i].join();
+    for (size_t i = 0; i < queues.size(); ++i)
+        delete queues[i];
+}
+
+#endif
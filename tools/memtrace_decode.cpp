@@ -0,0 +1,138 @@
+/**
+ * Decoder for the binary memtrace log (memtrace.bin, written with -DMEMTRACE_TO_FILE -DMEMTRACE_BINARY).
+ * Usage: memtrace_decode [--stats] [--top n] [file]
+ * Without --stats it prints the events oldest first, one per line, like the text memtrace.dump.
+ * With --stats it prints a summary, the busiest call sites and the blocks that were never freed.
+ * If the ring buffer wrapped around, only the last events are available and the summary says so.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+#include "memtrace_reader.h"
+
+static const char *op_names[] = {"malloc", "calloc", "realloc", "free", "new", "delete", "new[]", "delete[]"};
+
+struct SiteStats
+{
+    unsigned long long count = 0, freed = 0, bytes = 0, live = 0, peak = 0, lifetime = 0;
+};
+
+struct LiveBlock
+{
+    uint64_t size, time;
+    uint32_t site;
+};
+
+static void print_events(const memtrace::TraceReader &trace)
+{
+    std::printf("%14s %4s %-8s %18s %10s  %s\n", "time(ns)", "thr", "op", "pointer", "size", "site");
+    for (uint64_t i = 0; i < trace.count(); ++i)
+    {
+        const memtrace_event &e = trace.event(i);
+        std::printf("%14llu %4u %-8s %#18llx ", (unsigned long long)e.time, (unsigned int)e.thread,
+                    e.op < 8 ? op_names[e.op] : "?", (unsigned long long)e.ptr);
+        if (e.kind == MEMTRACE_TRACE_ALLOC)
+            std::printf("%10llu", (unsigned long long)e.size);
+        else
+            std::printf("%10s", "-");
+        std::printf("  %s\n", trace.site_name(e.site).c_str());
+    }
+}
+
+static void print_stats(const memtrace::TraceReader &trace, size_t top)
+{
+    std::map<uint32_t, SiteStats> sites;
+    std::map<uint64_t, LiveBlock> live;
+    unsigned long long live_bytes = 0, peak_bytes = 0, unmatched = 0;
+    for (uint64_t i = 0; i < trace.count(); ++i)
+    {
+        const memtrace_event &e = trace.event(i);
+        if (e.kind == MEMTRACE_TRACE_ALLOC)
+        {
+            SiteStats &s = sites[e.site];
+            ++s.count;
+            s.bytes += e.size;
+            s.live += e.size;
+            s.peak = std::max(s.peak, s.live);
+            live[e.ptr] = LiveBlock{e.size, e.time, e.site};
+            live_bytes += e.size;
+            peak_bytes = std::max(peak_bytes, live_bytes);
+            continue;
+        }
+        std::map<uint64_t, LiveBlock>::iterator it = live.find(e.ptr);
+        if (it == live.end())
+        {
+            // allocated before the oldest event still in the ring
+            ++unmatched;
+            continue;
+        }
+        SiteStats &s = sites[it->second.site];
+        ++s.freed;
+        s.live -= it->second.size;
+        s.lifetime += e.time - it->second.time;
+        live_bytes -= it->second.size;
+        live.erase(it);
+    }
+
+    std::printf("events: %llu", (unsigned long long)trace.count());
+    if (trace.dropped())
+        std::printf(" (the ring wrapped, the first %llu events are lost)", (unsigned long long)trace.dropped());
+    std::printf("\nthreads: %u, call sites: %llu\n", trace.threads(), (unsigned long long)trace.header().site_count);
+    std::printf("peak live bytes: %llu, frees of earlier blocks: %llu\n\n", peak_bytes, unmatched);
+
+    std::vector<std::pair<uint32_t, SiteStats> > list(sites.begin(), sites.end());
+    std::sort(list.begin(), list.end(), [](const std::pair<uint32_t, SiteStats> &a,
+                                           const std::pair<uint32_t, SiteStats> &b) { return a.second.bytes > b.second.bytes; });
+    std::printf("%10s %14s %12s %12s %14s  %s\n", "count", "bytes", "live", "peak", "lifetime(us)", "site");
+    for (size_t i = 0; i < list.size() && i < top; ++i)
+    {
+        const SiteStats &s = list[i].second;
+        std::printf("%10llu %14llu %12llu %12llu %14.1f  %s\n", s.count, s.bytes, s.live, s.peak,
+                    s.freed ? (double)s.lifetime / s.freed / 1000 : 0.0, trace.site_name(list[i].first).c_str());
+    }
+
+    std::printf("\nnot freed: %zu blocks, %llu bytes\n", live.size(), live_bytes);
+    size_t shown = 0;
+    for (std::map<uint64_t, LiveBlock>::const_iterator it = live.begin(); it != live.end() && shown < top; ++it, ++shown)
+        std::printf("  %#18llx %10llu  %s\n", (unsigned long long)it->first, (unsigned long long)it->second.size,
+                    trace.site_name(it->second.site).c_str());
+}
+
+int main(int argc, char **argv)
+{
+    std::string path = "memtrace.bin";
+    bool stats = false;
+    size_t top = 20;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg == "--stats")
+            stats = true;
+        else if (arg == "--top" && i + 1 < argc)
+            top = std::strtoul(argv[++i], nullptr, 10);
+        else if (arg[0] != '-')
+            path = arg;
+        else
+        {
+            std::fprintf(stderr, "usage: %s [--stats] [--top n] [file]\n", argv[0]);
+            return 2;
+        }
+    }
+    memtrace::TraceReader trace;
+    std::string error;
+    if (!trace.load(path, error))
+    {
+        std::fprintf(stderr, "%s: %s\n", path.c_str(), error.c_str());
+        return 1;
+    }
+    if (stats)
+        print_stats(trace, top);
+    else
+        print_events(trace);
+    return 0;
+}
@@ -0,0 +1,117 @@
+/**
+ * Reader for the binary memtrace log, shared by the tools.
+ */
+
+#ifndef MEMTRACE_READER_H
+#define MEMTRACE_READER_H
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "../memtrace_trace.h"
+
+namespace memtrace
+{
+    /**
+     * The whole memtrace.bin loaded into memory, the events are indexed oldest first.
+     */
+    class TraceReader
+    {
+        std::vector<char> data;
+        memtrace_trace_header hdr;
+        uint64_t first = 0;
+        unsigned int thread_count = 0;
+
+    public:
+        /**
+         * Loads and checks the file.
+         * @return false with the reason in error if the file is missing or is not a memtrace log
+         */
+        bool load(const std::string &path, std::string &error)
+        {
+            FILE *fp = std::fopen(path.c_str(), "rb");
+            if (fp == nullptr)
+            {
+                error = "cannot open";
+                return false;
+            }
+            char buf[1 << 16];
+            size_t n;
+            data.clear();
+            while ((n = std::fread(buf, 1, sizeof(buf), fp)) > 0)
+                data.insert(data.end(), buf, buf + n);
+            std::fclose(fp);
+            if (data.size() < sizeof(hdr))
+            {
+                error = "too short";
+                return false;
+            }
+            std::memcpy(&hdr, data.data(), sizeof(hdr));
+            if (std::memcmp(hdr.magic, MEMTRACE_TRACE_MAGIC, sizeof(hdr.magic)) != 0 ||
+                hdr.event_size != sizeof(memtrace_event) || hdr.site_size != sizeof(memtrace_site))
+            {
+                error = "not a memtrace log or different version";
+                return false;
+            }
+            if (hdr.events == 0 || (hdr.events & (hdr.events - 1)) != 0 ||
+                hdr.events_offset + hdr.events * sizeof(memtrace_event) > data.size() ||
+                hdr.sites_offset + hdr.sites * sizeof(memtrace_site) > data.size() ||
+                hdr.strings_offset + hdr.strings > data.size() || hdr.site_count > hdr.sites)
+            {
+                error = "truncated";
+                return false;
+            }
+            first = hdr.head > hdr.events ? hdr.head - hdr.events : 0;
+            thread_count = 0;
+            for (uint64_t i = 0; i < count(); ++i)
+                if (event(i).thread >= thread_count)
+                    thread_count = event(i).thread + 1u;
+            return true;
+        }
+
+        const memtrace_trace_header &header() const { return hdr; }
+
+        /**
+         * @return the number of events still in the ring
+         */
+        uint64_t count() const { return hdr.head - first; }
+
+        /**
+         * @return the number of events overwritten because the ring was full
+         */
+        uint64_t dropped() const { return first; }
+
+        unsigned int threads() const { return thread_count; }
+
+        /**
+         * @return the i-th event, 0 is the oldest one still in the ring
+         */
+        const memtrace_event &event(uint64_t i) const
+        {
+            const memtrace_event *events = reinterpret_cast<const memtrace_event *>(data.data() + hdr.events_offset);
+            return events[(first + i) & (hdr.events - 1)];
+        }
+
+        /**
+         * @return the call site as file:line, with the directories stripped
+         */
+        std::string site_name(uint32_t site) const
+        {
+            if (site == MEMTRACE_TRACE_NO_SITE || site >= hdr.site_count)
+                return "?";
+            const memtrace_site &s = reinterpret_cast<const memtrace_site *>(data.data() + hdr.sites_offset)[site];
+            std::string file = "?";
+            if (s.file != MEMTRACE_TRACE_NO_FILE && s.file < hdr.strings_used)
+            {
+                file = data.data() + hdr.strings_offset + s.file;
+                size_t slash = file.find_last_of("/\\");
+                if (slash != std::string::npos)
+                    file.erase(0, slash + 1);
+            }
+            return file + ":" + std::to_string(s.line);
+        }
+    };
+}
+
+#endif // MEMTRACE_READER_H
@@ -0,0 +1,381 @@
+/**
+ * Replays the allocations of a binary memtrace log against different allocators.
+ * Usage: memtrace_replay [--repeat n] [--allocator name] [file]
+ * Allocators: malloc (the system allocator), pool (the LimbPool of Bigint), arena (bump allocator).
+ * The events of all threads are replayed in one thread, in the order they were logged. Every block is
+ * filled when it is allocated, so the pages are really used. Frees of blocks allocated before the
+ * oldest event in the ring are skipped.
+ * Each allocator runs in its own child process, so the peak RSS of one does not hide the other.
+ * A child starts with the RSS the parent has at the fork, the replay operations; growth is the part
+ * of the peak that comes from the replay itself.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "memtrace_reader.h"
+#include "../bigint_pool.h"
+#if defined(__unix__) || defined(__APPLE__)
+#define REPLAY_FORK
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+/**
+ * One step of the replay: allocate size bytes into the slot, or free the block in the slot.
+ */
+struct ReplayOp
+{
+    uint64_t size;
+    uint32_t slot;
+    bool free;
+};
+
+/**
+ * The events turned into slot operations, the slots are reused, so there are only as many as the peak of live blocks.
+ */
+struct Replay
+{
+    std::vector<ReplayOp> ops;
+    uint32_t slots = 0;
+    uint64_t allocations = 0, skipped = 0;
+};
+
+static Replay build_replay(const memtrace::TraceReader &trace)
+{
+    Replay replay;
+    std::unordered_map<uint64_t, uint32_t> live;
+    std::vector<uint32_t> free_slots;
+    for (uint64_t i = 0; i < trace.count(); ++i)
+    {
+        const memtrace_event &e = trace.event(i);
+        if (e.kind == MEMTRACE_TRACE_ALLOC)
+        {
+            uint32_t slot;
+            if (!free_slots.empty())
+            {
+                slot = free_slots.back();
+                free_slots.pop_back();
+            }
+            else
+                slot = replay.slots++;
+            live[e.ptr] = slot;
+            replay.ops.push_back(ReplayOp{e.size, slot, false});
+            ++replay.allocations;
+            continue;
+        }
+        std::unordered_map<uint64_t, uint32_t>::iterator it = live.find(e.ptr);
+        if (it == live.end())
+        {
+            ++replay.skipped;
+            continue;
+        }
+        replay.ops.push_back(ReplayOp{0, it->second, true});
+        free_slots.push_back(it->second);
+        live.erase(it);
+    }
+    return replay;
+}
+
+class Allocator
+{
+public:
+    virtual ~Allocator() {}
+    virtual void *allocate(size_t size) = 0;
+    virtual void deallocate(void *p, size_t size) = 0;
+};
+
+class MallocAllocator : public Allocator
+{
+public:
+    void *allocate(size_t size) { return std::malloc(size ? size : 1); }
+    void deallocate(void *p, size_t) { std::free(p); }
+};
+
+/**
+ * The LimbPool of bigint_pool.h, the allocator behind Bigint without MEMTRACE. Its size classes are
+ * compile-time limb counts, so the sizes are rounded up to 16 byte classes up to 1 KB and every class is
+ * a LimbPool of its own. Larger blocks go to malloc.
+ */
+class PoolAllocator : public Allocator
+{
+    static const size_t granule = 16, max_size = 1024;
+    typedef unsigned int *(*allocate_fn)();
+    typedef void (*deallocate_fn)(unsigned int *);
+
+    template <size_t... c>
+    static allocate_fn allocate_class(const size_t &k, std::index_sequence<c...>)
+    {
+        static const allocate_fn fns[] = {&LimbPool<(c + 1) * granule / sizeof(unsigned int)>::allocate...};
+        return fns[k];
+    }
+
+    template <size_t... c>
+    static deallocate_fn deallocate_class(const size_t &k, std::index_sequence<c...>)
+    {
+        static const deallocate_fn fns[] = {&LimbPool<(c + 1) * granule / sizeof(unsigned int)>::deallocate...};
+        return fns[k];
+    }
+
+    // the index of the class, 0 is the 16 byte one
+    static size_t size_class(const size_t &size) { return size == 0 ? 0 : (size - 1) / granule; }
+
+public:
+    void *allocate(size_t size)
+    {
+        if (size > max_size)
+            return std::malloc(size);
+        return allocate_class(size_class(size), std::make_index_sequence<max_size / granule>())();
+    }
+
+    void deallocate(void *p, size_t size)
+    {
+        if (size > max_size)
+        {
+            std::free(p);
+            return;
+        }
+        deallocate_class(size_class(size), std::make_index_sequence<max_size / granule>())((unsigned int *)p);
+    }
+};
+
+/**
+ * Bump allocation from 1 MB chunks, free only counts the live blocks and the arena is rewound when none is left.
+ */
+class ArenaAllocator : public Allocator
+{
+    static const size_t chunk_size = 1024 * 1024, alignment = 16;
+    std::vector<char *> chunks;
+    size_t chunk = 0, used = chunk_size;
+    uint64_t live = 0;
+
+public:
+    ~ArenaAllocator()
+    {
+        for (size_t i = 0; i < chunks.size(); ++i)
+            std::free(chunks[i]);
+    }
+
+    void *allocate(size_t size)
+    {
+        size = (size + alignment - 1) & ~(alignment - 1);
+        if (size > chunk_size)
+        {
+            // oversized blocks get their own chunk, after a rewind it is used as an ordinary one
+            char *p = (char *)std::malloc(size);
+            if (p == nullptr)
+                return nullptr;
+            chunks.push_back(p);
+            ++live;
+            return p;
+        }
+        if (used + size > chunk_size)
+        {
+            if (++chunk >= chunks.size())
+            {
+                char *p = (char *)std::malloc(chunk_size);
+                if (p == nullptr)
+                    return nullptr;
+                chunks.push_back(p);
+                chunk = chunks.size() - 1;
+            }
+            used = 0;
+        }
+        void *p = chunks[chunk] + used;
+        used += size;
+        ++live;
+        return p;
+    }
+
+    void deallocate(void *, size_t)
+    {
+        if (--live == 0 && !chunks.empty())
+        {
+            chunk = 0;
+            used = 0;
+        }
+    }
+};
+
+static Allocator *make_allocator(const std::string &name)
+{
+    if (name == "malloc")
+        return new MallocAllocator;
+    if (name == "pool")
+        return new PoolAllocator;
+    if (name == "arena")
+        return new ArenaAllocator;
+    return nullptr;
+}
+
+struct ReplayResult
+{
+    double seconds;
+    long peak_rss_kb, rss_growth_kb;
+};
+
+static long peak_rss_kb()
+{
+#ifdef REPLAY_FORK
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+    return usage.ru_maxrss / 1024;
+#else
+    return usage.ru_maxrss;
+#endif
+#else
+    return 0;
+#endif
+}
+
+static ReplayResult run_replay(const Replay &replay, const std::string &name, unsigned int repeat)
+{
+    ReplayResult result;
+    std::vector<void *> slots(replay.slots, nullptr);
+    std::vector<uint64_t> sizes(replay.slots, 0);
+    long rss_before = peak_rss_kb();
+    Allocator *allocator = make_allocator(name);
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (unsigned int r = 0; r < repeat; ++r)
+    {
+        for (size_t i = 0; i < replay.ops.size(); ++i)
+        {
+            const ReplayOp &op = replay.ops[i];
+            if (op.free)
+            {
+                if (slots[op.slot] != nullptr)
+                    allocator->deallocate(slots[op.slot], sizes[op.slot]);
+                slots[op.slot] = nullptr;
+                continue;
+            }
+            void *p = allocator->allocate(op.size);
+            if (p != nullptr)
+                std::memset(p, 0x5a, op.size);
+            slots[op.slot] = p;
+            sizes[op.slot] = op.size;
+        }
+        // blocks that were not freed in the trace are released between the rounds
+        for (uint32_t s = 0; s < replay.slots; ++s)
+            if (slots[s] != nullptr)
+            {
+                allocator->deallocate(slots[s], sizes[s]);
+                slots[s] = nullptr;
+            }
+    }
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / repeat;
+    result.peak_rss_kb = peak_rss_kb();
+    result.rss_growth_kb = result.peak_rss_kb - rss_before;
+    delete allocator;
+    return result;
+}
+
+/**
+ * Runs the replay in a child process and gets the result through a pipe.
+ * @return false if the child failed
+ */
+static bool run_isolated(const Replay &replay, const std::string &name, unsigned int repeat, ReplayResult &result)
+{
+#ifdef REPLAY_FORK
+    int fds[2];
+    if (pipe(fds) != 0)
+        return false;
+    std::fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0)
+    {
+        close(fds[0]);
+        close(fds[1]);
+        return false;
+    }
+    if (pid == 0)
+    {
+        close(fds[0]);
+        ReplayResult r = run_replay(replay, name, repeat);
+        bool ok = write(fds[1], &r, sizeof(r)) == (ssize_t)sizeof(r);
+        close(fds[1]);
+        _exit(ok ? 0 : 1);
+    }
+    close(fds[1]);
+    bool ok = read(fds[0], &result, sizeof(result)) == (ssize_t)sizeof(result);
+    close(fds[0]);
+    int status = 0;
+    waitpid(pid, &status, 0);
+    return ok && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+#else
+    result = run_replay(replay, name, repeat);
+    return true;
+#endif
+}
+
+int main(int argc, char **argv)
+{
+    std::string path = "memtrace.bin";
+    std::vector<std::string> allocators;
+    unsigned int repeat = 5;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg == "--repeat" && i + 1 < argc)
+            repeat = std::max(1ul, std::strtoul(argv[++i], nullptr, 10));
+        else if (arg == "--allocator" && i + 1 < argc)
+            allocators.push_back(argv[++i]);
+        else if (arg[0] != '-')
+            path = arg;
+        else
+        {
+            std::fprintf(stderr, "usage: %s [--repeat n] [--allocator malloc|pool|arena] [file]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (allocators.empty())
+        allocators = {"malloc", "pool", "arena"};
+    for (size_t i = 0; i < allocators.size(); ++i)
+    {
+        Allocator *a = make_allocator(allocators[i]);
+        if (a == nullptr)
+        {
+            std::fprintf(stderr, "unknown allocator: %s\n", allocators[i].c_str());
+            return 2;
+        }
+        delete a;
+    }
+
+    // the trace is released before the children are forked: a child starts with the RSS of its parent
+    // as its peak, so a loaded trace would hide the peak of every allocator
+    Replay replay;
+    {
+        memtrace::TraceReader trace;
+        std::string error;
+        if (!trace.load(path, error))
+        {
+            std::fprintf(stderr, "%s: %s\n", path.c_str(), error.c_str());
+            return 1;
+        }
+        replay = build_replay(trace);
+    }
+    std::printf("%s: %llu allocations, %zu operations, %u slots, %llu frees skipped\n", path.c_str(),
+                (unsigned long long)replay.allocations, replay.ops.size(), replay.slots, (unsigned long long)replay.skipped);
+    std::printf("%-10s %12s %10s %14s %14s\n", "allocator", "replay (ms)", "ns/op", "peak RSS (KB)", "growth (KB)");
+    int failures = 0;
+    for (size_t i = 0; i < allocators.size(); ++i)
+    {
+        ReplayResult r;
+        if (!run_isolated(replay, allocators[i], repeat, r))
+        {
+            std::printf("%-10s failed\n", allocators[i].c_str());
+            ++failures;
+            continue;
+        }
+        std::printf("%-10s %12.3f %10.1f %14ld %14ld\n", allocators[i].c_str(), r.seconds * 1000,
+                    replay.ops.empty() ? 0.0 : r.seconds * 1e9 / replay.ops.size(), r.peak_rss_kb, r.rss_growth_kb);
+    }
+    return failures != 0;
+}